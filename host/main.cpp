@@ -0,0 +1,1849 @@
+/*
+ * Host entry point. Runs app_main() on the simulated FreeRTOS and, when a
+ * duration is given, prints simulator statistics and exits afterwards.
+ *
+ * usage: robohand-host [seconds]
+ *        robohand-host --bench-commands [count]
+ *        robohand-host --bench-topics [lookups]
+ *        robohand-host --bench-ring [count]
+ *        robohand-host --bench-variant [count]
+ *        robohand-host --bench-snapshot [writers and readers] [seconds]
+ *        robohand-host --bench-reconnect [count] [broker outage ms]
+ *        robohand-host --bench-spool [broker outage s] [--stay-offline]
+ *        robohand-host --bench-qos [messages per level]
+ *        robohand-host --bench-control [commands]
+ *        robohand-host --bench-slider [commands/s] [sweeps]
+ *        robohand-host --bench-trajectory [moves]
+ *        robohand-host --bench-pressure [finger]
+ *        robohand-host --bench-gestures [--built-in]
+ *        robohand-host --bench-acquisition [seconds] [settle time constant us]
+ *        robohand-host --bench-mux
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "MUX74HC4067.hpp"
+#include "acquisition.hpp"
+#include "commands.pb.h"
+#include "config.hpp"
+#include "control.hpp"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "gestures.hpp"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "hand_frame.hpp"
+#include "internal_api.hpp"
+#include "motion_profile.hpp"
+#include "mqtt.hpp"
+#include "pressure.hpp"
+#include "sim.hpp"
+#include "snapshot_buffer.hpp"
+#include "soc/gpio_reg.h"
+#include "spsc_ring.hpp"
+#include "topic_dispatch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <variant>
+#include <vector>
+
+extern "C" void app_main(void);
+
+// Resting readings of the sensors behind the multiplexers
+static constexpr int16_t restingAngle(size_t potentiometer)
+{
+    return 30 + potentiometer;
+}
+
+static constexpr uint16_t restingPressure(size_t gauge)
+{
+    return 400 + gauge;
+}
+
+// Multiplexer model: the sensor an enabled mux connects to the ADC pin,
+// nullptr for any other pin or an empty channel. slot is its storage index
+static const HandTopology::Sensor *muxSensor(uint8_t pin, size_t *slot = nullptr)
+{
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        const auto &pins = HandTopology::kMuxes[mux];
+        if (pins.sig != pin || sim::gpio::level(pins.en) != LOW)
+        {
+            continue;
+        }
+        uint8_t channel = sim::gpio::level(pins.s0) | sim::gpio::level(pins.s1) << 1 |
+                          sim::gpio::level(pins.s2) << 2 | sim::gpio::level(pins.s3) << 3;
+        size_t slots[2] = {0, 0};
+        for (auto &sensor : HandTopology::kSensors)
+        {
+            size_t &next = slots[static_cast<size_t>(sensor.kind)];
+            if (sensor.mux == mux && sensor.channel == channel)
+            {
+                if (slot != nullptr)
+                {
+                    *slot = next;
+                }
+                return &sensor;
+            }
+            next++;
+        }
+    }
+    return nullptr;
+}
+
+static uint16_t restingSensor(uint8_t pin)
+{
+    size_t slot;
+    const HandTopology::Sensor *sensor = muxSensor(pin, &slot);
+    if (sensor == nullptr)
+    {
+        return 0;
+    }
+    if (sensor->kind == HandTopology::SensorKind::StrainGauge)
+    {
+        return restingPressure(slot);
+    }
+    return std::lround(restingAngle(slot) * 4095.0 / CONFIG_SENSORS_POTENTIOMETER_RANGE_DEG);
+}
+
+// A resting hand: non-zero readings so messages have their real size
+static void seedHandState()
+{
+    HandState::update([](HandSnapshot &state)
+                      {
+                          for (size_t axis = 0; axis < HandLayout::kAxes; axis++)
+                          {
+                              for (size_t imu = 0; imu < HandLayout::kImus; imu++)
+                              {
+                                  state.imu_accel[axis][imu] = axis == 2 ? 9.81f : 0.12f;
+                                  state.imu_gyro[axis][imu] = 0.01f;
+                              }
+                              state.processed_imu_orientation[axis][0] = 1.5f;
+                          }
+                          for (size_t i = 0; i < HandLayout::kPotentiometers; i++)
+                          {
+                              state.potentiometer_angle[i] = restingAngle(i);
+                          }
+                          for (size_t i = 0; i < HandLayout::kStrainGauges; i++)
+                          {
+                              state.straingauge_pressure[i] = restingPressure(i);
+                          }
+                          for (size_t i = 0; i < HandLayout::kServos; i++)
+                          {
+                              state.servo_angle[i] = 90;
+                          } });
+    // the same readings for the sensor acquisition
+    sim::gpio::setAnalogSource(restingSensor);
+}
+
+static void printHeap()
+{
+    std::printf("heap: allocations=%llu", (unsigned long long)sim::heap::allocations());
+    for (auto &task : sim::heap::perTask())
+    {
+        std::printf(" %s=%llu", task.name.c_str(), (unsigned long long)task.allocations);
+    }
+    std::printf("\n");
+}
+
+static void printStats(double seconds)
+{
+    auto mqtt = sim::mqtt::stats();
+    std::printf("mqtt: publishes=%llu payload=%llu wire=%llu (%.1f publishes/s, %.1f wire bytes/s) subscribes=%llu delivered=%llu connects=%llu\n",
+                (unsigned long long)mqtt.publishes, (unsigned long long)mqtt.publish_bytes,
+                (unsigned long long)mqtt.wire_bytes, mqtt.publishes / seconds, mqtt.wire_bytes / seconds,
+                (unsigned long long)mqtt.subscribes, (unsigned long long)mqtt.delivered,
+                (unsigned long long)mqtt.connects);
+    for (auto lane : {MqttClient::Lane::Control, MqttClient::Lane::Telemetry})
+    {
+        auto stats = MqttClient::getInstance().getLaneStats(lane);
+        std::printf("%s lane: sent=%u dropped=%u failed=%u depth=%u max depth=%u queue us mean=%u max=%u\n",
+                    lane == MqttClient::Lane::Control ? "control" : "telemetry",
+                    stats.sent, stats.dropped, stats.failed, stats.depth, stats.depth_high_water,
+                    stats.queue_us_mean, stats.queue_us_max);
+    }
+    std::printf("gpio: writes=%llu\n", (unsigned long long)sim::gpio::writes());
+    printHeap();
+}
+
+// Measures how many commands per second the MQTT task parses and queues
+// without dropping any, the control loop drains the queue once per tick.
+// First in bursts the queue holds, each into an empty queue: decoding and
+// queuing alone. Then as a steady stream that never has more commands
+// pending than the queue holds: the rate the control loop sustains.
+// Returns false when a command was dropped at the full queue.
+static bool benchCommands(uint64_t count)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    Commands::ServoGoToAngle go_to_angle;
+    go_to_angle.set_servo(2);
+    go_to_angle.set_angle(120);
+    Commands::HoldGesture gesture;
+    gesture.set_gesture(3);
+    for (int i = 0; i < 6; i++)
+    {
+        gesture.add_angles(30 * i);
+    }
+    const std::string payloads[] = {go_to_angle.SerializeAsString(), gesture.SerializeAsString()};
+    const std::string topics[] = {MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, MQTT_TOPIC_COMMANDS_HOLD_GESTURE};
+    const uint64_t capacity = CONFIG_COMMANDS_QUEUE_CAPACITY;
+    auto handled = []()
+    { return sim::mqtt::stats().handled; };
+
+    auto queue_before = CommandsQueue::stats();
+    uint64_t allocations_before = sim::heap::allocations();
+
+    double burst_seconds = 0.0;
+    for (uint64_t i = 0; i < count;)
+    {
+        while (CommandsQueue::size() != 0)
+        {
+            std::this_thread::yield();
+        }
+        uint64_t burst = std::min(capacity, count - i);
+        uint64_t handled_before = handled();
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t j = 0; j < burst; j++, i++)
+        {
+            sim::mqtt::inject(topics[i & 1], payloads[i & 1]);
+        }
+        while (handled() - handled_before < burst)
+        {
+            std::this_thread::yield();
+        }
+        burst_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint64_t handled_before = handled();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        // not handled yet or handled and still queued
+        while (i - (handled() - handled_before) + CommandsQueue::size() >= capacity)
+        {
+            std::this_thread::yield();
+        }
+        sim::mqtt::inject(topics[i & 1], payloads[i & 1]);
+    }
+    while (handled() - handled_before < count)
+    {
+        std::this_thread::yield();
+    }
+    double stream_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t allocations = sim::heap::allocations() - allocations_before;
+    auto queue = CommandsQueue::stats();
+    uint64_t dropped = queue.dropped - queue_before.dropped;
+    std::printf("commands: decode and queue %.0f commands/s in bursts of %llu, sustained %.0f commands/s with the control loop draining\n",
+                count / burst_seconds, (unsigned long long)capacity, count / stream_seconds);
+    std::printf("  queued=%llu dropped=%llu, allocations=%llu (%.2f per command)\n",
+                (unsigned long long)(queue.pushed - queue_before.pushed), (unsigned long long)dropped,
+                (unsigned long long)allocations, double(allocations) / (2 * count));
+    if (dropped != 0)
+    {
+        std::printf("commands: %llu dropped at the full queue, the rates include rejects\n", (unsigned long long)dropped);
+    }
+    return dropped == 0;
+}
+
+// Topic lookup alone: the former std::string + compare chain against
+// TopicDispatcher, over a mix dominated by streaming servo targets
+static void benchTopics(uint64_t lookups)
+{
+    static const char *const kTopics[] = {
+        MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE,
+        MQTT_TOPIC_COMMANDS_SERVO_LOCK,
+        MQTT_TOPIC_COMMANDS_SERVO_UNLOCK,
+        MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE,
+        MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE,
+        MQTT_TOPIC_COMMANDS_HOLD_GESTURE,
+    };
+    static constexpr TopicDispatcher<6> dispatcher(MQTT_TOPIC_COMMANDS "/", {
+        MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE,
+        MQTT_TOPIC_COMMANDS_SERVO_LOCK,
+        MQTT_TOPIC_COMMANDS_SERVO_UNLOCK,
+        MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE,
+        MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE,
+        MQTT_TOPIC_COMMANDS_HOLD_GESTURE,
+    });
+    static_assert(dispatcher.valid());
+
+    // percent of traffic per topic, the rest are unrouted topics
+    const std::pair<std::string, int> mix[] = {
+        {MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, 55},
+        {MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE, 15},
+        {MQTT_TOPIC_COMMANDS_HOLD_GESTURE, 12},
+        {MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE, 8},
+        {MQTT_TOPIC_COMMANDS_SERVO_LOCK, 4},
+        {MQTT_TOPIC_COMMANDS_SERVO_UNLOCK, 4},
+        {MQTT_TOPIC_COMMANDS "/calibrate", 1},
+        {MQTT_TOPIC_COMMANDS, 1},
+    };
+    std::vector<std::string> topics;
+    for (auto &[topic, percent] : mix)
+    {
+        topics.insert(topics.end(), percent, topic);
+    }
+    std::shuffle(topics.begin(), topics.end(), std::mt19937(1));
+
+    auto run = [&](const char *name, auto &&find)
+    {
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < lookups; i++)
+        {
+            auto &topic = topics[i % topics.size()];
+            checksum += find(topic.data(), topic.size()) + 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%s: %.1f ns/lookup (checksum %llu)\n", name, seconds * 1e9 / lookups,
+                    (unsigned long long)checksum);
+    };
+
+    run("string chain", [&](const char *topic, size_t len)
+        {
+            std::string mqtt_topic(topic, len);
+            for (int i = 0; i < 6; i++)
+            {
+                if (mqtt_topic == kTopics[i])
+                {
+                    return i;
+                }
+            }
+            return -1; });
+    run("dispatcher", [&](const char *topic, size_t len)
+        { return dispatcher.find(topic, len); });
+}
+
+// SpscRing alone, a producer and a consumer thread on a ring of a command
+// queue's size. The producer pushes bursts and yields, the consumer pops
+// until the ring is empty and yields, so the run also means something on a
+// single core. Only the time inside bursts and drains counts. Reports ns
+// per push and per pop, the high water mark and the drops. The consumer
+// checks every element is whole and newer than the previous one. Returns
+// false if a check failed.
+template <OverflowPolicy Policy>
+static bool benchRingPolicy(const char *name, uint64_t count, size_t burst)
+{
+    struct Element
+    {
+        uint64_t sequence;
+        uint64_t payload[3];
+    };
+    using Ring = SpscRing<Element, CONFIG_COMMANDS_QUEUE_CAPACITY, Policy>;
+    // not assignable, a ring per run
+    auto ring = std::make_unique<Ring>();
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<bool> done{false};
+    Clock::duration push_time{};
+    std::thread producer([&]()
+                         {
+                             for (uint64_t i = 0; i < count;)
+                             {
+                                 auto start = Clock::now();
+                                 for (uint64_t end = std::min<uint64_t>(i + burst, count); i < end; i++)
+                                 {
+                                     ring->push({i, {i, ~i, i * 3}});
+                                 }
+                                 push_time += Clock::now() - start;
+                                 std::this_thread::yield();
+                             }
+                             done.store(true); });
+
+    uint64_t popped = 0;
+    uint64_t broken = 0;
+    uint64_t next = 0;
+    Clock::duration pop_time{};
+    Element element;
+    for (;;)
+    {
+        bool finished = done.load();
+        auto start = Clock::now();
+        uint64_t drained = 0;
+        while (ring->pop(element))
+        {
+            drained++;
+            broken += element.sequence < next || element.payload[0] != element.sequence ||
+                      element.payload[1] != ~element.sequence || element.payload[2] != element.sequence * 3;
+            next = element.sequence + 1;
+        }
+        if (drained != 0)
+        {
+            pop_time += Clock::now() - start;
+            popped += drained;
+        }
+        else if (finished)
+        {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    auto stats = ring->stats();
+    bool ok = broken == 0 && popped + stats.dropped == count;
+    std::printf("ring %s, bursts of %zu: %.1f ns/push, %.1f ns/pop, %llu popped, high water %u of %zu, dropped %u, %llu broken\n",
+                name, burst, std::chrono::duration<double, std::nano>(push_time).count() / count,
+                std::chrono::duration<double, std::nano>(pop_time).count() / std::max<uint64_t>(popped, 1),
+                (unsigned long long)popped, stats.high_water, Ring::capacity(), stats.dropped,
+                (unsigned long long)broken);
+    return ok;
+}
+
+static bool benchRing(uint64_t count)
+{
+    constexpr size_t kCapacity = CONFIG_COMMANDS_QUEUE_CAPACITY;
+    bool ok = true;
+    // a burst the ring holds, then one that overflows it
+    for (size_t burst : {kCapacity / 2, kCapacity * 2})
+    {
+        ok &= benchRingPolicy<OverflowPolicy::DropNewest>("drop newest", count, burst);
+        ok &= benchRingPolicy<OverflowPolicy::DropOldest>("drop oldest", count, burst);
+    }
+    return ok;
+}
+
+// HandState's SnapshotBuffer under load: writers threads publish snapshots
+// with every field set from one sequence number, readers threads pin the
+// latest snapshot and check every field carries the same number and that
+// it never goes back. Prints writes and reads per second. Returns false on
+// a torn or older snapshot.
+static bool benchSnapshot(int threads, double seconds)
+{
+    static SnapshotBuffer<HandSnapshot, HandState::kMaxReaders> buffer;
+
+    auto fill = [](HandSnapshot &snapshot, int64_t sequence)
+    {
+        snapshot.timestamp_us = sequence;
+        for (auto *axes : {snapshot.imu_accel, snapshot.imu_gyro})
+        {
+            for (size_t axis = 0; axis < HandLayout::kAxes; axis++)
+            {
+                std::fill_n(axes[axis], HandLayout::kImus, float(sequence));
+            }
+        }
+        for (auto &axis : snapshot.processed_imu_orientation)
+        {
+            std::fill(std::begin(axis), std::end(axis), float(sequence));
+        }
+        std::fill(std::begin(snapshot.potentiometer_angle), std::end(snapshot.potentiometer_angle), int16_t(sequence));
+        std::fill(std::begin(snapshot.straingauge_pressure), std::end(snapshot.straingauge_pressure), uint16_t(sequence));
+        std::fill(std::begin(snapshot.servo_angle), std::end(snapshot.servo_angle), int16_t(sequence));
+    };
+    auto whole = [](const HandSnapshot &snapshot)
+    {
+        // above 2^24 neighbouring numbers round to one float, the integer fields tell them apart
+        int64_t sequence = snapshot.timestamp_us;
+        bool ok = true;
+        for (auto *axes : {snapshot.imu_accel, snapshot.imu_gyro})
+        {
+            for (size_t axis = 0; axis < HandLayout::kAxes; axis++)
+            {
+                ok &= std::all_of(axes[axis], axes[axis] + HandLayout::kImus, [&](float v)
+                                  { return v == float(sequence); });
+            }
+        }
+        for (auto &axis : snapshot.processed_imu_orientation)
+        {
+            ok &= std::all_of(std::begin(axis), std::end(axis), [&](float v)
+                              { return v == float(sequence); });
+        }
+        ok &= std::all_of(std::begin(snapshot.potentiometer_angle), std::end(snapshot.potentiometer_angle),
+                          [&](int16_t v)
+                          { return v == int16_t(sequence); });
+        ok &= std::all_of(std::begin(snapshot.straingauge_pressure), std::end(snapshot.straingauge_pressure),
+                          [&](uint16_t v)
+                          { return v == uint16_t(sequence); });
+        ok &= std::all_of(std::begin(snapshot.servo_angle), std::end(snapshot.servo_angle), [&](int16_t v)
+                          { return v == int16_t(sequence); });
+        return ok;
+    };
+
+    buffer.write([&](HandSnapshot &snapshot)
+                 { fill(snapshot, 0); });
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> torn{0};
+    std::atomic<uint64_t> older{0};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 uint64_t count = 0;
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     // writers are serialised, the previous snapshot holds the last number
+                                     buffer.write([&](HandSnapshot &snapshot)
+                                                  { fill(snapshot, snapshot.timestamp_us + 1); });
+                                     count++;
+                                 }
+                                 writes += count; });
+        workers.emplace_back([&]()
+                             {
+                                 uint64_t count = 0;
+                                 int64_t last = 0;
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     auto snapshot = buffer.read();
+                                     if (!whole(*snapshot))
+                                     {
+                                         torn++;
+                                     }
+                                     if (snapshot->timestamp_us < last)
+                                     {
+                                         older++;
+                                     }
+                                     last = snapshot->timestamp_us;
+                                     count++;
+                                 }
+                                 reads += count; });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    std::printf("snapshot: %d writers %.0f writes/s, %d readers %.0f reads/s (%zu reader slots), %llu torn, %llu older than the previous\n",
+                threads, writes / seconds, threads, reads / seconds, HandState::kMaxReaders,
+                (unsigned long long)torn.load(), (unsigned long long)older.load());
+    return torn == 0 && older == 0;
+}
+
+// What a queued command cost before command_types.hpp and now: copies
+// count commands of the topic mix of --bench-topics into a queue's storage
+// and destroys them again, through the former variant of protobuf
+// messages and through CommandsQueue::CommandType.
+static void benchVariant(uint64_t count)
+{
+    using MessageCommand = std::variant<Commands::ServoGoToAngle, Commands::ServoLock, Commands::ServoUnLock,
+                                        Commands::ServoSmoothlyMove, Commands::MoveToTargetPressure,
+                                        Commands::HoldGesture>;
+
+    std::vector<MessageCommand> messages;
+    std::vector<CommandsQueue::CommandType> commands;
+    std::mt19937 random(1);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        uint32_t servo = random() % HandTopology::kServosCount;
+        uint32_t angle = random() % (CONFIG_SERVO_MAX_ANGLE + 1);
+        uint32_t percent = random() % 100;
+        if (percent < 55)
+        {
+            Commands::ServoGoToAngle message;
+            message.set_servo(servo);
+            message.set_angle(angle);
+            messages.emplace_back(message);
+        }
+        else if (percent < 70)
+        {
+            Commands::ServoSmoothlyMove message;
+            message.set_servo(servo);
+            message.set_angle(angle);
+            message.set_duration(500);
+            messages.emplace_back(message);
+        }
+        else if (percent < 82)
+        {
+            Commands::HoldGesture message;
+            message.set_gesture(random() % 6);
+            for (size_t j = 0; j < HandTopology::kServosCount; j++)
+            {
+                message.add_angles(random() % (CONFIG_SERVO_MAX_ANGLE + 1));
+            }
+            messages.emplace_back(message);
+        }
+        else if (percent < 90)
+        {
+            Commands::MoveToTargetPressure message;
+            message.set_finger(static_cast<Shared::Finger>(random() % 5));
+            message.set_pressure(angle * 10);
+            messages.emplace_back(message);
+        }
+        else if (percent < 95)
+        {
+            Commands::ServoLock message;
+            message.set_servo(servo);
+            messages.emplace_back(message);
+        }
+        else
+        {
+            Commands::ServoUnLock message;
+            message.set_servo(servo);
+            messages.emplace_back(message);
+        }
+        std::visit([&](auto &message)
+                   { commands.emplace_back(Command::decode(message)); },
+                   messages.back());
+    }
+
+    // allocations of this thread are counted from here on
+    sim::heap::attachTask("bench");
+    auto run = [&](const char *name, auto &source)
+    {
+        using Element = typename std::decay_t<decltype(source)>::value_type;
+        std::vector<Element> queued;
+        // a first pass touches the storage
+        queued.assign(source.begin(), source.end());
+        queued.clear();
+        uint64_t allocations = sim::heap::allocations();
+        auto start = std::chrono::steady_clock::now();
+        for (auto &command : source)
+        {
+            queued.push_back(command);
+        }
+        queued.clear();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%s: %zu bytes, %.1f ns and %.2f allocations per copy\n", name, sizeof(Element), ns / count,
+                    double(sim::heap::allocations() - allocations) / count);
+    };
+    run("protobuf variant", messages);
+    run("compact variant", commands);
+}
+
+// Plans random moves and checks every profile every 100 us: exact ends,
+// no reversal, no step above the peak velocity. Prints the distance to the
+// analytic S-curve and the largest velocity change between ticks. Then times a control tick
+// worth of lookups (one per servo) against the float smoothstep they
+// replaced. Returns false if a check failed.
+static bool benchTrajectory(int moves)
+{
+    constexpr uint32_t kPeriodUs = 1000000 / CONFIG_CONTROL_RATE_HZ;
+    constexpr uint32_t kStepUs = 100;
+    constexpr int32_t kMaxAngle = CONFIG_SERVO_MAX_ANGLE * MotionProfile::kOne;
+    static MotionProfile profile;
+    std::mt19937 random(1);
+    int failed = 0;
+    double max_error = 0;
+    double max_jump = 0;
+    for (int move = 0; move < moves; move++)
+    {
+        int32_t from = random() % (kMaxAngle + 1);
+        int32_t to = random() % (kMaxAngle + 1);
+        uint32_t duration = 10000 + random() % 3000000;
+        profile.plan(from, to, duration, kPeriodUs);
+
+        int32_t distance = std::abs(to - from);
+        // peak velocity 1.6 times the mean, plus the rounding of the samples
+        // and of the interpolation
+        double max_step = 1.6 * distance * kStepUs / duration + 3;
+        bool ok = profile.at(0) == from && profile.at(duration) == to;
+        int32_t previous = from;
+        double previous_velocity = 0;
+        for (uint32_t t = kStepUs; t <= duration; t += kStepUs)
+        {
+            int32_t angle = profile.at(t);
+            int32_t step = angle - previous;
+            ok &= (to >= from ? step >= 0 : step <= 0) && std::abs(step) <= max_step;
+            // the control loop evaluates at ticks, where the samples are
+            if (t % kPeriodUs == 0)
+            {
+                double expected = from + (to - from) * MotionProfile::shape(double(t) / duration);
+                max_error = std::max(max_error, std::abs(angle - expected) / MotionProfile::kOne);
+                double velocity = double(angle - profile.at(t - kPeriodUs)) / MotionProfile::kOne;
+                max_jump = std::max(max_jump, std::abs(velocity - previous_velocity));
+                previous_velocity = velocity;
+            }
+            previous = angle;
+        }
+        if (!ok)
+        {
+            failed++;
+            std::printf("move %d: %d -> %d in %u us failed\n", move, from, to, duration);
+        }
+    }
+    std::printf("trajectory: %d moves, %d failed, max distance to the S-curve %.3f deg, max velocity change per tick %.3f deg/tick\n",
+                moves, failed, max_error, max_jump);
+
+    // a tick: one lookup per servo
+    constexpr size_t kServos = HandTopology::kServosCount;
+    static MotionProfile profiles[kServos];
+    for (size_t i = 0; i < kServos; i++)
+    {
+        profiles[i].plan(0, kMaxAngle, 2000000, kPeriodUs);
+    }
+    constexpr uint32_t kTicks = 2000000;
+    auto run = [&](const char *name, auto &&evaluate)
+    {
+        int64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t tick = 0; tick < kTicks; tick++)
+        {
+            uint32_t elapsed = (tick * 997u) % 2000000;
+            for (size_t i = 0; i < kServos; i++)
+            {
+                checksum += evaluate(i, elapsed);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%s: %.1f ns/tick (checksum %lld)\n", name, seconds * 1e9 / kTicks, (long long)checksum);
+    };
+    run("profile lookup", [&](size_t i, uint32_t elapsed)
+        { return profiles[i].at(elapsed); });
+    volatile float duration = 2000000;
+    run("float smoothstep", [&](size_t i, uint32_t elapsed)
+        {
+            float s = elapsed / duration;
+            s = s * s * (3 - 2 * s);
+            return int32_t(CONFIG_SERVO_MAX_ANGLE * s * MotionProfile::kOne); });
+    return failed == 0;
+}
+
+// Drops the broker connection count times while a controller streams a
+// command every 500 us and reports CONNACK to first handled command. With
+// an outage the broker refuses connections for that long after every drop.
+static void benchReconnect(int count, int outage_ms)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    Commands::ServoGoToAngle go_to_angle;
+    go_to_angle.set_servo(1);
+    go_to_angle.set_angle(45);
+    const std::string payload = go_to_angle.SerializeAsString();
+
+    std::atomic<bool> done{false};
+    std::thread controller([&]()
+                           {
+                               while (!done.load())
+                               {
+                                   sim::mqtt::inject(MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, payload);
+                                   std::this_thread::sleep_for(std::chrono::microseconds(500));
+                               } });
+
+    size_t initial = sim::mqtt::firstDataDelays().size();
+    for (int i = 0; i < count; i++)
+    {
+        sim::mqtt::dropConnections();
+        if (outage_ms > 0)
+        {
+            sim::mqtt::setBrokerAvailable(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(outage_ms));
+            sim::mqtt::setBrokerAvailable(true);
+        }
+        while (sim::mqtt::firstDataDelays().size() < initial + i + 1)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // let the session settle (SUBACKs) before dropping it again
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    done = true;
+    controller.join();
+
+    auto delays = sim::mqtt::firstDataDelays();
+    uint64_t sum = 0, min = UINT64_MAX, max = 0;
+    for (size_t i = initial; i < delays.size(); i++)
+    {
+        sum += delays[i];
+        min = std::min(min, delays[i]);
+        max = std::max(max, delays[i]);
+    }
+    size_t n = delays.size() - initial;
+    std::printf("reconnects: %zu, CONNACK to first command: mean %llu us, min %llu us, max %llu us, subscribes=%llu\n",
+                n, (unsigned long long)(sum / n), (unsigned long long)min, (unsigned long long)max,
+                (unsigned long long)sim::mqtt::stats().subscribes);
+
+    auto stats = MqttClient::getInstance().getReconnectStats();
+    std::printf("firmware: reconnects=%lu attempts=%lu, offline mean %lld us, last attempt to CONNACK %lld us\n",
+                (unsigned long)stats.reconnects, (unsigned long)stats.attempts,
+                (long long)(stats.reconnects ? stats.disconnected_total_us / stats.reconnects : 0),
+                (long long)stats.last_connect_us);
+}
+
+// Sequence number of an encoded hand frame
+static uint32_t frameSequence(const std::string &payload)
+{
+    google::protobuf::io::CodedInputStream in(reinterpret_cast<const uint8_t *>(payload.data()), payload.size());
+    while (uint32_t tag = in.ReadTag())
+    {
+        if (tag == google::protobuf::internal::WireFormatLite::MakeTag(
+                       HandFrame::Sequence, google::protobuf::internal::WireFormatLite::WIRETYPE_VARINT))
+        {
+            uint32_t sequence;
+            return in.ReadVarint32(&sequence) ? sequence : 0;
+        }
+        if (!google::protobuf::internal::WireFormatLite::SkipField(&in, tag))
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Takes the broker away for outage_s while the hand keeps sampling, then
+// brings it back and follows the replay of the spooled frames. With
+// stay_offline the simulator exits during the outage; the frames stay in
+// the flash image and are replayed by the next run.
+static void benchSpool(double outage_s, bool stay_offline)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::mutex mutex;
+    std::vector<uint32_t> sequences;
+    auto first = std::chrono::steady_clock::time_point::max();
+    auto last = first;
+    sim::mqtt::setPublishObserver([&](const std::string &topic, const std::string &payload)
+                                  {
+                                      if (topic != MQTT_TOPIC_MONITORING_HAND_FRAME_REPLAY)
+                                      {
+                                          return;
+                                      }
+                                      std::lock_guard<std::mutex> lock(mutex);
+                                      last = std::chrono::steady_clock::now();
+                                      first = std::min(first, last);
+                                      sequences.push_back(frameSequence(payload));
+                                  });
+
+    uint64_t erases_before = sim::flash::erases();
+    uint64_t written_before = sim::flash::bytesWritten();
+    if (outage_s > 0)
+    {
+        sim::mqtt::setBrokerAvailable(false);
+        sim::mqtt::dropConnections();
+        std::this_thread::sleep_for(std::chrono::duration<double>(outage_s));
+        std::printf("spool: outage of %.1f s, %llu bytes written to flash, %llu sectors erased\n", outage_s,
+                    (unsigned long long)(sim::flash::bytesWritten() - written_before),
+                    (unsigned long long)(sim::flash::erases() - erases_before));
+        if (stay_offline)
+        {
+            return;
+        }
+        sim::mqtt::setBrokerAvailable(true);
+    }
+
+    // the reconnect backoff decides when the replay starts
+    auto restored = std::chrono::steady_clock::now();
+    while (!MqttClient::getInstance().isConnected())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto reconnected = std::chrono::steady_clock::now();
+    std::printf("spool: reconnected %.1f s after the broker came back\n",
+                std::chrono::duration<double>(reconnected - restored).count());
+
+    // replay is done when nothing came for a few periods
+    auto idle = std::chrono::milliseconds(4 * CONFIG_MIDDLEWARE_SENDING_STATE_PERIOD);
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(mutex);
+        auto since = last == std::chrono::steady_clock::time_point::max() ? reconnected : last;
+        if (std::chrono::steady_clock::now() - since > idle)
+        {
+            break;
+        }
+    }
+    sim::mqtt::setPublishObserver(nullptr);
+
+    size_t gaps = 0;
+    for (size_t i = 1; i < sequences.size(); i++)
+    {
+        gaps += sequences[i] != sequences[i - 1] + 1;
+    }
+    double seconds = sequences.empty() ? 0.0 : std::chrono::duration<double>(last - first).count();
+    std::printf("spool: replayed %zu frames (sequence %u..%u, %zu gaps) in %.1f s, %.1f frames/s\n",
+                sequences.size(), sequences.empty() ? 0 : sequences.front(),
+                sequences.empty() ? 0 : sequences.back(), gaps, seconds,
+                seconds > 0 ? (sequences.size() - 1) / seconds : 0.0);
+}
+
+// Sends count ServoGoToAngle commands, alternating between two angles, and
+// times each one from the broker to the duty change of the servo pin. The
+// firmware side of the same latency (MQTT task to the PWM update) is
+// printed from ControlLoop::stats().
+static void benchControl(int count)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    constexpr uint8_t kServo = 1;
+    const uint8_t pin = HandTopology::kServos[kServo].pwm_pin;
+    std::vector<uint64_t> latencies;
+    for (int i = 0; i < count; i++)
+    {
+        Commands::ServoGoToAngle go_to_angle;
+        go_to_angle.set_servo(kServo);
+        go_to_angle.set_angle(i % 2 ? 45 : 135);
+        uint32_t duty = sim::gpio::ledcDuty(pin);
+        auto start = std::chrono::steady_clock::now();
+        sim::mqtt::inject(MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, go_to_angle.SerializeAsString());
+        while (sim::gpio::ledcDuty(pin) == duty)
+        {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(1))
+            {
+                std::printf("command %d: no pwm change within 1 s\n", i);
+                return;
+            }
+            std::this_thread::yield();
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+        // land at a random phase of the next control period
+        std::this_thread::sleep_for(std::chrono::microseconds(20000 + std::rand() % 10000));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t sum = 0;
+    for (auto latency : latencies)
+    {
+        sum += latency;
+    }
+    std::printf("control: %d commands, broker to pwm: mean %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+                count, (unsigned long long)(sum / latencies.size()),
+                (unsigned long long)latencies[latencies.size() / 2],
+                (unsigned long long)latencies[latencies.size() * 99 / 100],
+                (unsigned long long)latencies.back());
+    auto stats = ControlLoop::stats();
+    std::printf("firmware: ticks=%lu overruns=%lu commands=%lu coalesced=%lu expired=%lu rejected=%lu, mqtt task to pwm mean %lu us max %lu us\n",
+                (unsigned long)stats.ticks, (unsigned long)stats.overruns, (unsigned long)stats.commands,
+                (unsigned long)stats.coalesced, (unsigned long)stats.expired, (unsigned long)stats.rejected,
+                (unsigned long)stats.latency_us_mean, (unsigned long)stats.latency_us_max);
+}
+
+// A slider dragged back and forth: every sweep streams ServoGoToAngle for
+// one servo from 45 to 135 degrees (or back) one degree per command at
+// rate commands/s. Times each sweep from its last command to the servo
+// duty reaching the final angle and prints how many commands the control
+// loop executed and how many the queue coalesced. Build with and without
+// CONFIG_COMMANDS_COALESCE to compare.
+static void benchSlider(int rate, int sweeps)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    esp_log_level_set("MQTT", ESP_LOG_ERROR);
+
+    constexpr uint8_t kServo = 1;
+    constexpr int kLow = 45;
+    constexpr int kHigh = 135;
+    const uint8_t pin = HandTopology::kServos[kServo].pwm_pin;
+    auto goToAngle = [](int angle)
+    {
+        Commands::ServoGoToAngle go_to_angle;
+        go_to_angle.set_servo(kServo);
+        go_to_angle.set_angle(angle);
+        sim::mqtt::inject(MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, go_to_angle.SerializeAsString());
+    };
+    // duty of both ends, a lone command each
+    auto settle = [&](int angle)
+    {
+        goToAngle(angle);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return sim::gpio::ledcDuty(pin);
+    };
+    const uint32_t duty_low = settle(kLow);
+    const uint32_t duty_high = settle(kHigh);
+
+    auto before = ControlLoop::stats();
+    auto queue_before = CommandsQueue::stats();
+    std::vector<uint64_t> lags;
+    int lost = 0;
+    const auto period = std::chrono::nanoseconds(1000000000LL / std::max(rate, 1));
+    for (int sweep = 0; sweep < sweeps; sweep++)
+    {
+        bool up = sweep % 2 == 0;
+        auto next = std::chrono::steady_clock::now();
+        for (int angle = kLow; angle <= kHigh; angle++)
+        {
+            std::this_thread::sleep_until(next);
+            goToAngle(up ? angle : kLow + kHigh - angle);
+            next += period;
+        }
+        auto last = std::chrono::steady_clock::now();
+        uint32_t target = up ? duty_high : duty_low;
+        while (sim::gpio::ledcDuty(pin) != target)
+        {
+            if (std::chrono::steady_clock::now() - last > std::chrono::seconds(1))
+            {
+                break;
+            }
+            std::this_thread::yield();
+        }
+        if (sim::gpio::ledcDuty(pin) != target)
+        {
+            // the final command was dropped, the servo stays off target
+            lost++;
+            settle(up ? kHigh : kLow);
+            continue;
+        }
+        lags.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - last)
+                           .count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+
+    auto stats = ControlLoop::stats();
+    auto queue = CommandsQueue::stats();
+    int sent = sweeps * (kHigh - kLow + 1);
+    std::sort(lags.begin(), lags.end());
+    uint64_t sum = 0;
+    for (auto lag : lags)
+    {
+        sum += lag;
+    }
+    std::printf("slider: %d sweeps, %d commands at %d/s, coalescing %s\n", sweeps, sent, rate,
+#ifdef CONFIG_COMMANDS_COALESCE
+                "on"
+#else
+                "off"
+#endif
+    );
+    std::printf("last command to final duty: mean %llu us, p50 %llu us, max %llu us, final command lost %d\n",
+                (unsigned long long)(lags.empty() ? 0 : sum / lags.size()),
+                (unsigned long long)(lags.empty() ? 0 : lags[lags.size() / 2]),
+                (unsigned long long)(lags.empty() ? 0 : lags.back()), lost);
+    std::printf("executed=%lu coalesced=%lu expired=%lu queue dropped=%lu high water=%lu\n",
+                (unsigned long)(stats.commands - before.commands),
+                (unsigned long)(stats.coalesced - before.coalesced),
+                (unsigned long)(stats.expired - before.expired),
+                (unsigned long)(queue.dropped - queue_before.dropped), (unsigned long)queue.high_water);
+}
+
+// Finger plant for the pressure controller: the servo follows its PWM
+// setpoint with a first order lag and a speed limit, past the contact angle
+// the finger presses with a linear stiffness and the gauge reads the force
+// through a first order filter and some noise. Gauges are served through
+// the multiplexer model (enable and select pins), other channels read mid
+// scale. Stepped by its own thread at about 10 kHz.
+class FingerPlant
+{
+public:
+    static constexpr double kContactDeg = 100;
+    static constexpr double kStiffness = 40;     // gauge units per degree past contact
+    static constexpr double kServoTau = 0.02;    // s
+    static constexpr double kServoSpeed = 600;   // deg/s
+    static constexpr double kGaugeTau = 0.005;   // s
+    static constexpr double kNoise = 3;          // gauge units, peak
+
+    struct Sample
+    {
+        double t; // s since start
+        double force;
+    };
+
+    explicit FingerPlant(size_t finger)
+        : finger(finger), servo(HandTopology::fingerServo(finger))
+    {
+        sim::gpio::setAnalogSource([this](uint8_t pin)
+                                   { return read(pin); });
+        thread = std::thread([this]
+                             { run(); });
+    }
+
+    ~FingerPlant()
+    {
+        stop = true;
+        thread.join();
+        sim::gpio::setAnalogSource(restingSensor);
+    }
+
+    std::vector<Sample> samples()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return history;
+    }
+
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    const size_t finger;
+    const size_t servo;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<uint16_t> gauge{0};
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    std::vector<Sample> history;
+    std::thread thread;
+
+    uint16_t read(uint8_t pin)
+    {
+        const HandTopology::Sensor *sensor = muxSensor(pin);
+        if (sensor != nullptr && sensor->kind == HandTopology::SensorKind::StrainGauge)
+        {
+            return sensor->finger == finger ? gauge.load() : 0;
+        }
+        return 2048;
+    }
+
+    // setpoint of the servo from its LEDC duty
+    double commanded(double current)
+    {
+        uint32_t duty = sim::gpio::ledcDuty(HandTopology::kServos[servo].pwm_pin);
+        if (duty == 0)
+        {
+            return current; // released
+        }
+        double pulse_us = duty * (1e6 / CONFIG_SERVO_PWM_FREQUENCY) / 16383;
+        return (pulse_us - CONFIG_SERVO_MIN_PULSE_US) * CONFIG_SERVO_MAX_ANGLE /
+               (CONFIG_SERVO_MAX_PULSE_US - CONFIG_SERVO_MIN_PULSE_US);
+    }
+
+    void run()
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> noise(-kNoise, kNoise);
+        double position = CONFIG_SERVO_MAX_ANGLE / 2.0;
+        double force = 0;
+        double previous = 0;
+        while (!stop)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            double t = now();
+            double dt = std::min(t - previous, 0.01);
+            previous = t;
+            double velocity = (commanded(position) - position) / kServoTau;
+            position += std::clamp(velocity, -kServoSpeed, kServoSpeed) * dt;
+            double pressed = std::max(0.0, position - kContactDeg) * kStiffness;
+            force += (pressed - force) * std::min(dt / kGaugeTau, 1.0);
+            gauge = std::clamp<int>(std::lround(force + noise(random)), 0, 4095);
+            std::lock_guard<std::mutex> lock(mutex);
+            history.push_back({t, force});
+        }
+    }
+};
+
+// Closes one finger on the simulated plant with a sequence of
+// MoveToTargetPressure steps and reports, for every step, the overshoot,
+// the settling time into a 5 % band and the steady state error.
+static void benchPressure(size_t finger)
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    FingerPlant plant(finger);
+    constexpr double kStepS = 3;
+    const uint32_t targets[] = {1000, 2500, 1500, 400};
+    std::printf("pressure: finger %zu, %d Hz, kp %d ki %d kd %d (milli), slew %d deg/s\n", finger,
+                CONFIG_CONTROL_RATE_HZ, CONFIG_CONTROL_PRESSURE_KP_MILLI, CONFIG_CONTROL_PRESSURE_KI_MILLI,
+                CONFIG_CONTROL_PRESSURE_KD_MILLI, CONFIG_CONTROL_MAX_SPEED_DEG_S);
+    double previous_target = 0;
+    for (uint32_t target : targets)
+    {
+        Commands::MoveToTargetPressure command;
+        command.set_finger(static_cast<Shared::Finger>(finger));
+        command.set_pressure(target);
+        double start = plant.now();
+        sim::mqtt::inject(MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE, command.SerializeAsString());
+        std::this_thread::sleep_for(std::chrono::duration<double>(kStepS));
+
+        double band = 0.05 * target;
+        double settled = -1;
+        double peak = previous_target;
+        double tail = 0;
+        int tail_count = 0;
+        bool rising = target >= previous_target;
+        for (auto &sample : plant.samples())
+        {
+            if (sample.t < start || sample.t > start + kStepS)
+            {
+                continue;
+            }
+            peak = rising ? std::max(peak, sample.force) : std::min(peak, sample.force);
+            if (std::abs(sample.force - target) > band)
+            {
+                settled = -1;
+            }
+            else if (settled < 0)
+            {
+                settled = sample.t - start;
+            }
+            if (sample.t > start + kStepS - 0.5)
+            {
+                tail += sample.force;
+                tail_count++;
+            }
+        }
+        double overshoot = rising ? peak - target : target - peak;
+        if (settled < 0)
+        {
+            std::printf("target %4u: not settled within %.1f s, peak %.0f\n", target, kStepS, peak);
+        }
+        else
+        {
+            std::printf("target %4u: settled in %4.0f ms, overshoot %5.1f %%, steady state error %+.1f\n", target,
+                        settled * 1000, std::max(0.0, overshoot) * 100 / target,
+                        tail_count ? tail / tail_count - target : 0.0);
+        }
+        previous_target = target;
+    }
+    auto stats = PressureController::stats();
+    std::printf("controller: steps=%lu saturated=%lu gauge sweeps=%lu max sweep %lu us\n",
+                (unsigned long)stats.steps, (unsigned long)stats.saturated,
+                (unsigned long)stats.acquisitions, (unsigned long)stats.acquisition_us_max);
+}
+
+// Gesture table image for the bench: two gestures of the built-in table
+// and two longer sequences, built the way an offline tool would
+static std::vector<uint8_t> gestureImage()
+{
+    using namespace GestureTable;
+    struct Gesture
+    {
+        const char *name;
+        uint8_t id;
+        std::vector<Keyframe> keyframes;
+    };
+    auto pose = [](uint16_t time_ms, std::initializer_list<int> degrees)
+    {
+        Keyframe keyframe = {time_ms, {}};
+        size_t i = 0;
+        for (int angle : degrees)
+        {
+            keyframe.angles[i++] = angle * MotionProfile::kOne;
+        }
+        return keyframe;
+    };
+    std::vector<Gesture> gestures = {
+        {"open", 0, {pose(500, {0, 0, 0, 0, 0, 0})}},
+        {"fist", 1, {pose(500, {170, 180, 180, 180, 180, 90})}},
+        {"count", 10, {}},
+        {"sweep", 11, {}},
+    };
+    // fingers open one by one
+    for (int i = 0; i <= 5; i++)
+    {
+        gestures[2].keyframes.push_back(pose(300 * (i + 1), {i > 0 ? 0 : 170, i > 1 ? 0 : 180, i > 2 ? 0 : 180,
+                                                            i > 3 ? 0 : 180, i > 4 ? 0 : 180, 90}));
+    }
+    // every servo back and forth, 32 keyframes
+    for (int i = 0; i < 32; i++)
+    {
+        int angle = i % 2 ? 150 : 30;
+        gestures[3].keyframes.push_back(pose(100 * (i + 1), {angle, angle, angle, angle, angle, angle}));
+    }
+
+    size_t size = sizeof(Header) + gestures.size() * sizeof(Entry);
+    for (auto &gesture : gestures)
+    {
+        size += gesture.keyframes.size() * sizeof(Keyframe);
+    }
+    std::vector<uint8_t> image(size);
+    Header header = {kMagic, kVersion, uint8_t(HandTopology::kServosCount), uint8_t(gestures.size()),
+                     uint32_t(size), 0};
+    size_t offset = sizeof(Header) + gestures.size() * sizeof(Entry);
+    for (size_t i = 0; i < gestures.size(); i++)
+    {
+        Entry entry = {};
+        std::strncpy(entry.name, gestures[i].name, sizeof(entry.name) - 1);
+        entry.id = gestures[i].id;
+        entry.keyframes = gestures[i].keyframes.size();
+        entry.servos = (1u << HandTopology::kServosCount) - 1;
+        entry.offset = offset;
+        std::memcpy(&image[sizeof(Header) + i * sizeof(Entry)], &entry, sizeof(entry));
+        std::memcpy(&image[offset], gestures[i].keyframes.data(), gestures[i].keyframes.size() * sizeof(Keyframe));
+        offset += gestures[i].keyframes.size() * sizeof(Keyframe);
+    }
+    std::memcpy(image.data(), &header, sizeof(header));
+    header.crc = crc(image.data(), image.size());
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+// Writes the bench table to the gestures partition before the firmware
+// starts, or erases it to run on the built-in table
+static void writeGestures(bool built_in)
+{
+    const esp_partition_t *partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_GESTURES_PARTITION);
+    if (partition == nullptr)
+    {
+        std::printf("gestures: no partition %s\n", CONFIG_GESTURES_PARTITION);
+        return;
+    }
+    esp_partition_erase_range(partition, 0, partition->size);
+    if (!built_in)
+    {
+        auto image = gestureImage();
+        std::printf("gestures: image of %zu bytes, valid %d\n", image.size(),
+                    GestureTable::valid(image.data(), image.size()));
+        esp_partition_write(partition, 0, image.data(), image.size());
+    }
+}
+
+// Lists the loaded gesture table with the bytes every gesture takes, times
+// starting a gesture and a tick of playback against planning one
+// MotionProfile per servo (what HoldGesture did before), and plays a
+// gesture by id from the broker to its final pose on servo 1.
+static void benchGestures()
+{
+    while (sim::mqtt::stats().subscribes == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    using GestureTable::Entry;
+    using GestureTable::Keyframe;
+    std::printf("gestures: %zu %s, %zu bytes\n", GestureStore::count(),
+                GestureStore::builtIn() ? "built in" : "from the partition", GestureStore::size());
+    for (size_t i = 0; i < GestureStore::count(); i++)
+    {
+        const Entry &entry = GestureStore::entries()[i];
+        std::printf("  %3u %-12.*s %2u keyframes, %4zu bytes, %5u ms\n", entry.id, (int)sizeof(entry.name), entry.name,
+                    entry.keyframes, sizeof(Entry) + entry.keyframes * sizeof(Keyframe),
+                    GestureStore::keyframes(entry)[entry.keyframes - 1].time_ms);
+    }
+    std::printf("playback state %zu bytes, per servo profiles %zu bytes\n", sizeof(GesturePlayer),
+                sizeof(MotionProfile) * HandTopology::kServosCount);
+
+    constexpr uint32_t kPeriodUs = 1000000 / CONFIG_CONTROL_RATE_HZ;
+    constexpr int kRepeats = 2000;
+    static GesturePlayer player;
+    static MotionProfile profiles[HandTopology::kServosCount];
+    GesturePlayer::Angle from[HandTopology::kServosCount] = {};
+    GesturePlayer::Angle pose[HandTopology::kServosCount];
+    for (size_t i = 0; i < GestureStore::count(); i++)
+    {
+        const Entry &entry = GestureStore::entries()[i];
+        const Keyframe *keyframes = GestureStore::keyframes(entry);
+        uint32_t duration_us = keyframes[entry.keyframes - 1].time_ms * 1000u;
+
+        int64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < kRepeats; r++)
+        {
+            player.start(&entry, keyframes, from);
+        }
+        double start_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kRepeats;
+
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < kRepeats; r++)
+        {
+            for (size_t servo = 0; servo < HandTopology::kServosCount; servo++)
+            {
+                profiles[servo].plan(from[servo], keyframes[entry.keyframes - 1].angles[servo], duration_us, kPeriodUs);
+            }
+        }
+        double plan_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kRepeats;
+
+        uint64_t ticks = 0;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < kRepeats / 10; r++)
+        {
+            player.start(&entry, keyframes, from);
+            for (uint32_t t = 0; t <= duration_us; t += kPeriodUs, ticks++)
+            {
+                player.at(t, pose);
+                checksum += pose[1];
+            }
+        }
+        double tick_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ticks;
+        std::printf("  %-12.*s start %6.1f ns (per servo plans %8.1f ns), tick %5.1f ns (checksum %lld)\n",
+                    (int)sizeof(entry.name), entry.name, start_ns, plan_ns, tick_ns, (long long)checksum);
+    }
+
+    // broker to the final pose of the fist, by id only
+    const Entry *fist = GestureStore::find(1);
+    if (fist == nullptr)
+    {
+        return;
+    }
+    const Keyframe &last = GestureStore::keyframes(*fist)[fist->keyframes - 1];
+    const uint8_t pin = HandTopology::kServos[1].pwm_pin;
+    Commands::HoldGesture open;
+    open.set_gesture(0);
+    sim::mqtt::inject(MQTT_TOPIC_COMMANDS_HOLD_GESTURE, open.SerializeAsString());
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint32_t open_duty = sim::gpio::ledcDuty(pin);
+
+    Commands::HoldGesture command;
+    command.set_gesture(1);
+    auto start = std::chrono::steady_clock::now();
+    sim::mqtt::inject(MQTT_TOPIC_COMMANDS_HOLD_GESTURE, command.SerializeAsString());
+    uint32_t duty = open_duty;
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint32_t now = sim::gpio::ledcDuty(pin);
+        if (now == duty && now != open_duty)
+        {
+            // unchanged for a while: settled
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            if (sim::gpio::ledcDuty(pin) == now)
+            {
+                break;
+            }
+        }
+        duty = now;
+    }
+    std::printf("fist: servo 1 duty %u -> %u in %lld ms (keyframe %u ms, %u deg)\n", open_duty, duty,
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                last.time_ms, last.angles[1] / MotionProfile::kOne);
+}
+
+// Times MUX74HC4067::read, the per sample path the acquisition replaces, on
+// spare pins before the firmware starts: GPIO writes and time per sample.
+static void benchMuxLibrary()
+{
+    constexpr int kSamples = HandTopology::kMuxChannels * 4000;
+    MUX74HC4067 mux(10, 11, 12, 13, 14);
+    mux.signalPin(3, INPUT, ANALOG);
+    uint64_t writes = sim::gpio::writes();
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kSamples; i++)
+    {
+        checksum += mux.read(i % HandTopology::kMuxChannels);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kSamples;
+    std::printf("MUX74HC4067::read: %.2f GPIO writes, %.0f ns per sample (checksum %u)\n",
+                double(sim::gpio::writes() - writes) / kSamples, ns, checksum);
+}
+
+// Runs the timer driven acquisition for a while and reports samples and
+// sweeps per second, GPIO writes per sample, step jitter and the shortest
+// settle time, then checks HandState holds the multiplexer inputs.
+static bool benchAcquisition(double seconds)
+{
+    // the first sweeps
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    SensorAcquisition::Stats before = SensorAcquisition::stats();
+    sim::adc::Stats adc_before = sim::adc::stats();
+    uint64_t writes = sim::gpio::writes();
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    SensorAcquisition::Stats after = SensorAcquisition::stats();
+    sim::adc::Stats adc_after = sim::adc::stats();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint32_t samples = after.samples - before.samples;
+    uint32_t steps = after.steps - before.steps;
+
+#ifdef CONFIG_SENSORS_ADC_DMA
+    std::printf("acquisition, ADC continuous: %.0f samples/s, %.1f sweeps/s, %zu sensors, %d conversions/s, "
+                "%d of %d conversions per channel discarded\n",
+                samples / elapsed, (after.sweeps - before.sweeps) / elapsed, HandTopology::kSensorsCount,
+                CONFIG_SENSORS_DMA_SAMPLE_RATE_HZ, CONFIG_SENSORS_DMA_DISCARD, CONFIG_SENSORS_DMA_CONVERSIONS);
+    std::printf("  %.0f conversions/s simulated, %.2f GPIO writes per sample, frames skipped %u, late max %u us, "
+                "settle min %u us\n",
+                (adc_after.conversions - adc_before.conversions) / elapsed,
+                samples ? double(sim::gpio::writes() - writes) / samples : 0.0, after.overruns - before.overruns,
+                after.jitter_us_max, after.settle_us_min);
+    std::printf("  simulator: %llu conversions before the switch, %llu frames lost\n",
+                (unsigned long long)(adc_after.late_conversions - adc_before.late_conversions),
+                (unsigned long long)(adc_after.lost_frames - adc_before.lost_frames));
+#else
+    std::printf("acquisition, timer: %.0f samples/s, %.1f sweeps/s, %zu sensors, step %d us\n", samples / elapsed,
+                (after.sweeps - before.sweeps) / elapsed, HandTopology::kSensorsCount, CONFIG_SENSORS_SETTLE_US);
+    std::printf("  %.2f GPIO writes per sample, step jitter max %u us, settle min %u us, overruns %u\n",
+                samples ? double(sim::gpio::writes() - writes) / samples : 0.0, after.jitter_us_max,
+                after.settle_us_min, after.overruns);
+#endif
+    std::printf("  CPU %.2f%% in steps, %.2f us per step, step max %u us, sweeps dropped before the control loop "
+                "took them %u\n",
+                (after.busy_us - before.busy_us) / elapsed / 1e4, steps ? double(after.busy_us - before.busy_us) / steps : 0.0,
+                after.step_us_max, after.dropped);
+
+    size_t wrong = 0;
+    {
+        auto snapshot = HandState::snapshot();
+        for (size_t i = 0; i < HandLayout::kPotentiometers; i++)
+        {
+            wrong += snapshot->potentiometer_angle[i] != restingAngle(i);
+        }
+        for (size_t i = 0; i < HandLayout::kStrainGauges; i++)
+        {
+            wrong += snapshot->straingauge_pressure[i] != restingPressure(i);
+        }
+    }
+    std::printf("HandState: %zu of %zu channels differ from the multiplexer inputs\n", wrong,
+                HandLayout::kPotentiometers + HandLayout::kStrainGauges);
+    return wrong == 0;
+}
+
+// Checks that every channel switch, of MUX74HC4067 and of the acquisition,
+// is at most two GPIO_OUT set / clear register writes touching only the
+// mux pins and leaving the select pattern and the enable line on them.
+// Then times a switch against one digitalWrite per pin, the way
+// setChannel did it.
+static bool benchMux()
+{
+    struct Write
+    {
+        uint32_t reg;
+        uint32_t value;
+    };
+    std::vector<Write> log;
+    sim::gpio::setRegisterObserver([&log](uint32_t reg, uint32_t value)
+                                   { log.push_back({reg, value}); });
+    size_t switches = 0;
+    size_t failures = 0;
+    auto check = [&](const char *what, size_t channel, uint8_t en, bool enabled, const uint8_t *lines,
+                     bool disable_first)
+    {
+        uint32_t pins = GpioOut::mask(en);
+        uint8_t selected = 0;
+        for (size_t bit = 0; bit < 4; bit++)
+        {
+            pins |= GpioOut::mask(lines[bit]);
+            selected |= sim::gpio::level(lines[bit]) << bit;
+        }
+        bool ok = log.size() <= (disable_first ? 4 : 2) && selected == channel &&
+                  sim::gpio::level(en) == (enabled ? LOW : HIGH);
+        for (const Write &write : log)
+        {
+            ok &= (write.reg == GPIO_OUT_W1TS_REG || write.reg == GPIO_OUT_W1TC_REG) && (write.value & ~pins) == 0;
+        }
+        // the connection is off while the select lines change: EN goes high
+        // alone before them and low alone after them
+        if (disable_first)
+        {
+            size_t selects_end = log.size() - (enabled ? 1 : 0);
+            ok &= !log.empty() && log[0].reg == GPIO_OUT_W1TS_REG && log[0].value == GpioOut::mask(en);
+            ok &= !enabled || (log.back().reg == GPIO_OUT_W1TC_REG && log.back().value == GpioOut::mask(en));
+            for (size_t i = 1; i < selects_end && i < log.size(); i++)
+            {
+                ok &= (log[i].value & GpioOut::mask(en)) == 0;
+            }
+        }
+        if (!ok && failures++ < 10)
+        {
+            std::printf("  %s channel %zu: %zu writes, selects %u, enable %d\n", what, channel, log.size(), selected,
+                        sim::gpio::level(en));
+        }
+        switches++;
+    };
+
+    const uint8_t lines[] = {11, 12, 13, 14};
+    MUX74HC4067 mux(10, lines[0], lines[1], lines[2], lines[3]);
+    for (uint8_t set : {ENABLED, DISABLED})
+    {
+        for (size_t channel = 0; channel < HandTopology::kMuxChannels; channel++)
+        {
+            log.clear();
+            mux.setChannel(channel, set);
+            check("MUX74HC4067", channel, 10, set == ENABLED, lines, true);
+        }
+    }
+
+    SensorAcquisition::configure();
+    for (size_t m = 0; m < HandTopology::kMuxesCount; m++)
+    {
+        const auto &pins = HandTopology::kMuxes[m];
+        const uint8_t mux_lines[] = {pins.s0, pins.s1, pins.s2, pins.s3};
+        for (size_t channel = 0; channel < HandTopology::kMuxChannels; channel++)
+        {
+            log.clear();
+            SensorAcquisition::select(m, channel);
+            check("acquisition", channel, pins.en, true, mux_lines, false);
+        }
+        log.clear();
+        SensorAcquisition::select(m, HandTopology::kMuxChannels - 1);
+        failures += !log.empty();
+    }
+    sim::gpio::setRegisterObserver(nullptr);
+    std::printf("channel switches: %zu checked, %zu wrong\n", switches, failures);
+
+    constexpr int kSwitches = 160000;
+    uint64_t writes = sim::gpio::writes();
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < kSwitches; i++)
+    {
+        mux.setChannel(i % HandTopology::kMuxChannels);
+    }
+    double cycles = double(esp_cpu_get_cycle_count() - start) / kSwitches;
+    double per_switch = double(sim::gpio::writes() - writes) / kSwitches;
+
+    writes = sim::gpio::writes();
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < kSwitches; i++)
+    {
+        int channel = i % HandTopology::kMuxChannels;
+        digitalWrite(10, HIGH);
+        for (uint8_t line : lines)
+        {
+            digitalWrite(line, channel & 1);
+            channel >>= 1;
+        }
+        digitalWrite(10, LOW);
+    }
+    double cycles_digital_write = double(esp_cpu_get_cycle_count() - start) / kSwitches;
+    std::printf("setChannel: %.1f register writes, %.0f cycles; digitalWrite per pin: %.1f writes, %.0f cycles\n",
+                per_switch, cycles, double(sim::gpio::writes() - writes) / kSwitches, cycles_digital_write);
+    std::printf("  (host cycles are time at 240 MHz, the firmware logs target cycles when it configures the muxes)\n");
+    return failures == 0;
+}
+
+// Publishes count keyframe sized messages at every QoS level, one at a
+// time, each waiting for its handshake to complete, and reports the round
+// trips per second and the packets and bytes each message costs on the
+// link. Then prints the configured policy of every topic class.
+static void benchQos(int count)
+{
+    // app_main creates the client, there is no instance before the first connect
+    while (sim::mqtt::stats().connects == 0 || !MqttClient::getInstance().isConnected())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // the firmware publishes meanwhile, only the awaited msg_id counts
+    struct Completion
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        int awaited = -1;
+        bool done = false;
+    };
+    static Completion completion;
+    esp_mqtt_client_handle_t client = MqttClient::getInstance().getClient();
+    esp_mqtt_client_register_event(client, MQTT_EVENT_PUBLISHED, [](void *, esp_event_base_t, int32_t, void *event_data)
+                                   {
+                                       auto *event = static_cast<esp_mqtt_event_handle_t>(event_data);
+                                       std::lock_guard<std::mutex> lock(completion.mutex);
+                                       if (event->msg_id == completion.awaited)
+                                       {
+                                           completion.done = true;
+                                           completion.changed.notify_all();
+                                       } },
+                                   nullptr);
+
+    const std::string payload(HandFrame::kMaxSize, 'x');
+    const char *topic = MQTT_TOPIC_MONITORING "/bench-qos";
+    for (int qos = 0; qos <= 2; qos++)
+    {
+        auto before = sim::mqtt::stats();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            // the acknowledgement comes a round trip after the publish returns
+            int msg_id = esp_mqtt_client_publish(client, topic, payload.data(), payload.size(), qos, 0);
+            if (msg_id < 0)
+            {
+                std::printf("qos %d: publish failed\n", qos);
+                return;
+            }
+            if (qos > 0)
+            {
+                std::unique_lock<std::mutex> lock(completion.mutex);
+                completion.awaited = msg_id;
+                completion.done = false;
+                completion.changed.wait(lock, []()
+                                        { return completion.done; });
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto after = sim::mqtt::stats();
+        std::printf("qos %d: %d messages, %.0f round trips/s, %.1f packets and %.0f wire bytes per message\n",
+                    qos, count, count / seconds,
+                    double(after.wire_packets - before.wire_packets) / count,
+                    double(after.wire_bytes - before.wire_bytes) / count);
+    }
+
+    // control messages between QoS 1 publishes of others, whose PUBACKs
+    // must not hold or free control slots
+    MqttClient &mqtt = MqttClient::getInstance();
+    auto control_before = mqtt.getLaneStats(MqttClient::Lane::Control);
+    for (int i = 0; i < count; i++)
+    {
+        esp_mqtt_client_publish(client, topic, payload.data(), payload.size(), 1, 0);
+        while (mqtt.getLaneStats(MqttClient::Lane::Control).depth >= CONFIG_MQTT_CONTROL_MAX_INFLIGHT)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        mqtt.sendControl(topic, payload.data(), 64);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (mqtt.getLaneStats(MqttClient::Lane::Control).depth != 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto control = mqtt.getLaneStats(MqttClient::Lane::Control);
+    std::printf("control lane: %lu sent, %lu refused, %lu awaiting PUBACK after the last one\n",
+                (unsigned long)(control.sent - control_before.sent),
+                (unsigned long)(control.dropped - control_before.dropped), (unsigned long)control.depth);
+
+    const std::pair<const char *, MqttClient::TopicClass> classes[] = {
+        {"telemetry", MqttClient::TopicClass::Telemetry},
+        {"state", MqttClient::TopicClass::StateSnapshot},
+        {"notifications", MqttClient::TopicClass::Notifications},
+        {"commands", MqttClient::TopicClass::Commands},
+    };
+    for (auto &[name, topic_class] : classes)
+    {
+        auto policy = MqttClient::policy(topic_class);
+        std::printf("policy %s: qos %d retain %d\n", name, policy.qos, policy.retain);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && std::strcmp(argv[1], "--bench-topics") == 0)
+    {
+        benchTopics(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench-ring") == 0)
+    {
+        return benchRing(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench-snapshot") == 0)
+    {
+        return benchSnapshot(argc > 2 ? std::atoi(argv[2]) : int(HandState::kMaxReaders), argc > 3 ? std::atof(argv[3]) : 2.0)
+                   ? 0
+                   : 1;
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench-variant") == 0)
+    {
+        benchVariant(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench-trajectory") == 0)
+    {
+        return benchTrajectory(argc > 2 ? std::atoi(argv[2]) : 1000) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench-mux") == 0)
+    {
+        return benchMux() ? 0 : 1;
+    }
+
+    bool bench_commands = argc > 1 && std::strcmp(argv[1], "--bench-commands") == 0;
+    bool bench_reconnect = argc > 1 && std::strcmp(argv[1], "--bench-reconnect") == 0;
+    bool bench_spool = argc > 1 && std::strcmp(argv[1], "--bench-spool") == 0;
+    bool bench_qos = argc > 1 && std::strcmp(argv[1], "--bench-qos") == 0;
+    bool bench_control = argc > 1 && std::strcmp(argv[1], "--bench-control") == 0;
+    bool bench_slider = argc > 1 && std::strcmp(argv[1], "--bench-slider") == 0;
+    bool bench_pressure = argc > 1 && std::strcmp(argv[1], "--bench-pressure") == 0;
+    bool bench_gestures = argc > 1 && std::strcmp(argv[1], "--bench-gestures") == 0;
+    bool bench_acquisition = argc > 1 && std::strcmp(argv[1], "--bench-acquisition") == 0;
+    double seconds = argc > 1 && !bench_commands && !bench_reconnect && !bench_spool && !bench_qos && !bench_control &&
+                             !bench_slider && !bench_pressure && !bench_gestures && !bench_acquisition
+                         ? std::atof(argv[1])
+                         : 0.0;
+
+    seedHandState();
+    if (bench_gestures)
+    {
+        // the firmware loads the table at boot
+        writeGestures(argc > 2 && std::strcmp(argv[2], "--built-in") == 0);
+    }
+    if (bench_acquisition)
+    {
+        benchMuxLibrary();
+        // RC time constant of the multiplexer outputs
+        sim::adc::setSettleTime(argc > 3 ? std::atof(argv[3]) : 0.0);
+    }
+
+    xTaskCreate([](void *)
+                { app_main(); },
+                "main", 8192, nullptr, 1, nullptr);
+
+    if (bench_commands)
+    {
+        bool passed = benchCommands(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000);
+        std::fflush(stdout);
+        std::_Exit(passed ? 0 : 1);
+    }
+
+    if (bench_reconnect)
+    {
+        benchReconnect(argc > 2 ? std::atoi(argv[2]) : 5, argc > 3 ? std::atoi(argv[3]) : 0);
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_spool)
+    {
+        benchSpool(argc > 2 ? std::atof(argv[2]) : 10.0, argc > 3 && std::strcmp(argv[3], "--stay-offline") == 0);
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_control)
+    {
+        benchControl(argc > 2 ? std::atoi(argv[2]) : 200);
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_slider)
+    {
+        benchSlider(argc > 2 ? std::atoi(argv[2]) : 1000, argc > 3 ? std::atoi(argv[3]) : 20);
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_pressure)
+    {
+        benchPressure(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : size_t(HandTopology::Index));
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_gestures)
+    {
+        benchGestures();
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (bench_acquisition)
+    {
+        bool passed = benchAcquisition(argc > 2 ? std::atof(argv[2]) : 5.0);
+        std::fflush(stdout);
+        std::_Exit(passed ? 0 : 1);
+    }
+
+    if (bench_qos)
+    {
+        benchQos(argc > 2 ? std::atoi(argv[2]) : 500);
+        std::fflush(stdout);
+        std::_Exit(0);
+    }
+
+    if (seconds <= 0.0)
+    {
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    printStats(seconds);
+    std::fflush(stdout);
+    std::_Exit(0);
+}
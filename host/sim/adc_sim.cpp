@@ -0,0 +1,273 @@
+/*
+ * ADC continuous (DMA) mode. One thread per handle produces conversion
+ * frames at the sample rate from the simulated analog inputs and calls
+ * on_conv_done with every frame, in interrupt context.
+ *
+ * The conversions keep their nominal times, like the DMA that does not
+ * wait for the interrupt: a conversion before the callback of the previous
+ * frame returned sees the input as it was before that callback, e.g. the
+ * previous multiplexer channel. The callback is taken to start at the end
+ * of its frame and to take as long as it actually ran, the scheduling delay
+ * of the host is not part of the model. After a change an input settles
+ * with the RC time constant of sim::adc::setSettleTime.
+ */
+
+#include "esp_adc/adc_continuous.h"
+#include "sim.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // behind by more frames than this the simulator skips ahead
+    constexpr uint64_t kMaxLateFrames = 16;
+
+    std::atomic<double> settle_tau_us{0.0};
+    std::atomic<uint64_t> conversions{0};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> lost_frames{0};
+    std::atomic<uint64_t> late_conversions{0};
+
+    // Input of one pattern entry: settling from `from` to `to` since `changed`
+    struct Input
+    {
+        uint8_t pin;
+        double from;
+        double to;
+        Clock::time_point changed;
+
+        double at(Clock::time_point t) const
+        {
+            double tau = settle_tau_us.load();
+            if (t < changed)
+            {
+                return from;
+            }
+            if (tau <= 0.0)
+            {
+                return to;
+            }
+            double elapsed_us = std::chrono::duration<double, std::micro>(t - changed).count();
+            return to + (from - to) * std::exp(-elapsed_us / tau);
+        }
+    };
+}
+
+struct adc_continuous_ctx_t
+{
+    std::mutex mutex;
+    uint32_t frame_bytes = 0;
+    uint32_t sample_freq_hz = 0;
+    std::vector<adc_digi_pattern_config_t> pattern;
+    adc_continuous_evt_cbs_t callbacks = {};
+    void *user_data = nullptr;
+    // bumped by start and stop, a running thread of an older one exits
+    uint32_t generation = 0;
+    bool running = false;
+};
+
+void sim::adc::setSettleTime(double tau_us)
+{
+    settle_tau_us.store(tau_us);
+}
+
+sim::adc::Stats sim::adc::stats()
+{
+    return {conversions.load(), frames.load(), lost_frames.load(), late_conversions.load()};
+}
+
+esp_err_t adc_continuous_io_to_channel(int io_num, adc_unit_t *unit_id, adc_channel_t *channel)
+{
+    if (io_num >= 1 && io_num <= 10)
+    {
+        *unit_id = ADC_UNIT_1;
+        *channel = static_cast<adc_channel_t>(io_num - 1);
+        return ESP_OK;
+    }
+    if (io_num >= 11 && io_num <= 20)
+    {
+        *unit_id = ADC_UNIT_2;
+        *channel = static_cast<adc_channel_t>(io_num - 11);
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *hdl_config, adc_continuous_handle_t *ret_handle)
+{
+    if (hdl_config->conv_frame_size == 0 || hdl_config->conv_frame_size % SOC_ADC_DIGI_DATA_BYTES_PER_CONV != 0 ||
+        hdl_config->max_store_buf_size < hdl_config->conv_frame_size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim::heap::Untracked untracked;
+    auto *handle = new adc_continuous_ctx_t;
+    handle->frame_bytes = hdl_config->conv_frame_size;
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t *config)
+{
+    if (config->pattern_num == 0 || config->pattern_num > SOC_ADC_PATT_LEN_MAX ||
+        config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW || config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH ||
+        config->conv_mode != ADC_CONV_SINGLE_UNIT_1 || config->format != ADC_DIGI_OUTPUT_FORMAT_TYPE2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (handle->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim::heap::Untracked untracked;
+    handle->pattern.assign(config->adc_pattern, config->adc_pattern + config->pattern_num);
+    handle->sample_freq_hz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t *cbs,
+                                                  void *user_data)
+{
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (handle->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->callbacks = *cbs;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        if (handle->running || handle->pattern.empty())
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        handle->running = true;
+        generation = ++handle->generation;
+    }
+    sim::heap::Untracked untracked;
+    std::thread([handle, generation]()
+                {
+                    std::vector<adc_digi_pattern_config_t> pattern;
+                    adc_continuous_evt_cbs_t callbacks;
+                    void *user_data;
+                    uint32_t frame_bytes;
+                    uint32_t sample_freq_hz;
+                    {
+                        std::lock_guard<std::mutex> lock(handle->mutex);
+                        pattern = handle->pattern;
+                        callbacks = handle->callbacks;
+                        user_data = handle->user_data;
+                        frame_bytes = handle->frame_bytes;
+                        sample_freq_hz = handle->sample_freq_hz;
+                    }
+                    const size_t per_frame = frame_bytes / SOC_ADC_DIGI_RESULT_BYTES;
+                    auto conversion = std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(1.0 / sample_freq_hz));
+                    auto start = Clock::now();
+
+                    std::vector<Input> inputs;
+                    for (auto &entry : pattern)
+                    {
+                        // ADC1 channel n is GPIO n + 1, ADC2 channel n GPIO n + 11
+                        uint8_t pin = entry.channel + (entry.unit == ADC_UNIT_1 ? 1 : 11);
+                        double value = sim::gpio::analog(pin);
+                        inputs.push_back({pin, value, value, start});
+                    }
+                    std::vector<uint8_t> frame(frame_bytes);
+                    uint64_t converted = 0; // conversions since start, nominal times
+                    for (;;)
+                    {
+                        auto end = start + conversion * (converted + per_frame);
+                        std::this_thread::sleep_until(end);
+                        auto now = Clock::now();
+                        if (now - end > conversion * per_frame * kMaxLateFrames)
+                        {
+                            uint64_t behind = (now - end) / (conversion * per_frame);
+                            lost_frames += behind;
+                            converted += behind * per_frame;
+                        }
+                        {
+                            std::lock_guard<std::mutex> lock(handle->mutex);
+                            if (handle->generation != generation)
+                            {
+                                return;
+                            }
+                        }
+                        for (size_t i = 0; i < per_frame; i++, converted++)
+                        {
+                            const adc_digi_pattern_config_t &entry = pattern[converted % pattern.size()];
+                            const Input &input = inputs[converted % pattern.size()];
+                            auto t = start + conversion * converted;
+                            late_conversions += t < input.changed;
+                            double full_scale = (1u << entry.bit_width) - 1;
+                            double value = std::min(std::max(std::round(input.at(t)), 0.0), full_scale);
+                            adc_digi_output_data_t result = {};
+                            result.type2.data = static_cast<uint32_t>(value);
+                            result.type2.channel = entry.channel;
+                            result.type2.unit = entry.unit;
+                            std::memcpy(frame.data() + i * SOC_ADC_DIGI_RESULT_BYTES, &result, sizeof(result));
+                        }
+                        conversions += per_frame;
+                        frames++;
+                        auto called = Clock::now();
+                        if (callbacks.on_conv_done)
+                        {
+                            adc_continuous_evt_data_t data = {frame.data(), frame_bytes};
+                            sim::IsrScope isr;
+                            callbacks.on_conv_done(handle, &data, user_data);
+                        }
+                        // whatever the callback switched applies from its return on
+                        auto returned = start + conversion * converted + (Clock::now() - called);
+                        for (Input &input : inputs)
+                        {
+                            double value = sim::gpio::analog(input.pin);
+                            if (value != input.to)
+                            {
+                                input.from = input.at(returned);
+                                input.to = value;
+                                input.changed = returned;
+                            }
+                        }
+                    } })
+        .detach();
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (!handle->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = false;
+    handle->generation++;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle)
+{
+    // the frame thread may still hold the handle, it is never freed
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    if (handle->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,349 @@
+/*
+ * GPIO, ADC, LEDC and general purpose timers of the simulated board.
+ */
+
+#include "Arduino.h"
+#include "driver/gpio.h"
+#include "sim.hpp"
+#include "soc/gpio_reg.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// One thread per timer, alarms fire at absolute times so they do not drift
+struct timer_struct_t
+{
+    uint32_t frequency;
+    std::mutex mutex;
+    void (*handler)(void *) = nullptr;
+    void (*plain_handler)(void) = nullptr;
+    void *arg = nullptr;
+    uint64_t alarm_value = 0;
+    bool autoreload = false;
+    // bumped by timerAlarm and timerEnd, a running thread of an older one exits
+    uint32_t generation = 0;
+};
+
+namespace
+{
+    constexpr size_t kPinsCount = GPIO_NUM_MAX;
+
+    std::array<std::atomic<int>, kPinsCount> levels{};
+    std::array<std::atomic<uint16_t>, kPinsCount> analog_values{};
+    std::array<std::atomic<uint32_t>, kPinsCount> ledc_duties{};
+    std::atomic<uint64_t> gpio_writes{0};
+    std::atomic<uint64_t> register_writes{0};
+    std::mutex observer_mutex;
+    sim::gpio::RegisterObserver register_observer;
+    std::atomic<uint8_t> adc_bits{12};
+
+    std::mutex source_mutex;
+    sim::gpio::AnalogSource analog_source;
+}
+
+int sim::gpio::level(uint8_t pin)
+{
+    return pin < kPinsCount ? levels[pin].load() : 0;
+}
+
+void sim::gpio::setLevel(uint8_t pin, int level)
+{
+    if (pin < kPinsCount)
+    {
+        levels[pin].store(level ? HIGH : LOW);
+    }
+}
+
+void sim::gpio::setAnalog(uint8_t pin, uint16_t value)
+{
+    if (pin < kPinsCount)
+    {
+        analog_values[pin].store(value);
+    }
+}
+
+void sim::gpio::setAnalogSource(AnalogSource source)
+{
+    std::lock_guard<std::mutex> lock(source_mutex);
+    analog_source = std::move(source);
+}
+
+uint32_t sim::gpio::ledcDuty(uint8_t pin)
+{
+    return pin < kPinsCount ? ledc_duties[pin].load() : 0;
+}
+
+uint64_t sim::gpio::writes()
+{
+    return gpio_writes.load();
+}
+
+uint64_t sim::gpio::registerWrites()
+{
+    return register_writes.load();
+}
+
+void sim::gpio::setRegisterObserver(RegisterObserver observer)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex);
+    register_observer = std::move(observer);
+}
+
+// GPIO_OUT (pins 0-31) and GPIO_OUT1 (32 and up): write, set and clear
+void sim_reg_write(uint32_t reg, uint32_t value)
+{
+    size_t first;
+    int level;
+    bool whole = false;
+    switch (reg)
+    {
+    case GPIO_OUT_REG:
+    case GPIO_OUT1_REG:
+        whole = true;
+        [[fallthrough]];
+    case GPIO_OUT_W1TS_REG:
+    case GPIO_OUT1_W1TS_REG:
+        level = HIGH;
+        break;
+    case GPIO_OUT_W1TC_REG:
+    case GPIO_OUT1_W1TC_REG:
+        level = LOW;
+        break;
+    default:
+        return;
+    }
+    first = reg == GPIO_OUT_REG || reg == GPIO_OUT_W1TS_REG || reg == GPIO_OUT_W1TC_REG ? 0 : 32;
+    for (size_t bit = 0; bit < 32 && first + bit < kPinsCount; bit++)
+    {
+        if (value >> bit & 1)
+        {
+            levels[first + bit].store(level);
+        }
+        else if (whole)
+        {
+            levels[first + bit].store(LOW);
+        }
+    }
+    gpio_writes++;
+    register_writes++;
+    std::lock_guard<std::mutex> lock(observer_mutex);
+    if (register_observer)
+    {
+        register_observer(reg, value);
+    }
+}
+
+uint32_t sim_reg_read(uint32_t reg)
+{
+    size_t first = reg == GPIO_OUT_REG ? 0 : reg == GPIO_OUT1_REG ? 32 : kPinsCount;
+    uint32_t value = 0;
+    for (size_t bit = 0; bit < 32 && first + bit < kPinsCount; bit++)
+    {
+        value |= uint32_t(levels[first + bit].load() == HIGH) << bit;
+    }
+    return value;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    gpio_writes++;
+    sim::gpio::setLevel(pin, val);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return sim::gpio::level(pin);
+}
+
+uint16_t sim::gpio::analog(uint8_t pin)
+{
+    std::lock_guard<std::mutex> lock(source_mutex);
+    return analog_source ? analog_source(pin) : (pin < kPinsCount ? analog_values[pin].load() : 0);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    uint16_t value = sim::gpio::analog(pin);
+    uint8_t bits = adc_bits.load();
+    return bits >= 12 ? value : value >> (12 - bits);
+}
+
+void analogReadResolution(uint8_t bits)
+{
+    adc_bits.store(bits);
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    ledcWrite(pin, value);
+}
+
+bool ledcAttach(uint8_t pin, uint32_t freq, uint8_t resolution)
+{
+    return pin < kPinsCount;
+}
+
+bool ledcWrite(uint8_t pin, uint32_t duty)
+{
+    if (pin >= kPinsCount)
+    {
+        return false;
+    }
+    ledc_duties[pin].store(duty);
+    return true;
+}
+
+uint32_t ledcRead(uint8_t pin)
+{
+    return sim::gpio::ledcDuty(pin);
+}
+
+bool ledcDetach(uint8_t pin)
+{
+    if (pin >= kPinsCount)
+    {
+        return false;
+    }
+    ledc_duties[pin].store(0);
+    return true;
+}
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(esp_timer_get_time());
+}
+
+unsigned long millis()
+{
+    return static_cast<unsigned long>(esp_timer_get_time() / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    sim::gpio::setLevel(gpio_num, LOW);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_writes++;
+    sim::gpio::setLevel(gpio_num, level);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return sim::gpio::level(gpio_num);
+}
+
+hw_timer_t *timerBegin(uint32_t frequency)
+{
+    if (frequency == 0)
+    {
+        return nullptr;
+    }
+    sim::heap::Untracked untracked;
+    auto *timer = new timer_struct_t;
+    timer->frequency = frequency;
+    return timer;
+}
+
+void timerEnd(hw_timer_t *timer)
+{
+    // the alarm thread may still hold the timer, it is never freed
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->generation++;
+}
+
+void timerAttachInterrupt(hw_timer_t *timer, void (*userFunc)(void))
+{
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->plain_handler = userFunc;
+    timer->handler = nullptr;
+}
+
+void timerAttachInterruptArg(hw_timer_t *timer, void (*userFunc)(void *), void *arg)
+{
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    timer->handler = userFunc;
+    timer->plain_handler = nullptr;
+    timer->arg = arg;
+}
+
+void timerAlarm(hw_timer_t *timer, uint64_t alarm_value, bool autoreload, uint64_t reload_count)
+{
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->alarm_value = alarm_value;
+        timer->autoreload = autoreload;
+        generation = ++timer->generation;
+    }
+    sim::heap::Untracked untracked;
+    std::thread([timer, generation, reload_count]()
+                {
+                    auto period = std::chrono::nanoseconds(timer->alarm_value * 1000000000ULL / timer->frequency);
+                    auto next = std::chrono::steady_clock::now() + period;
+                    for (uint64_t fired = 0; reload_count == 0 || fired < reload_count; fired++)
+                    {
+                        std::this_thread::sleep_until(next);
+                        next += period;
+                        void (*handler)(void *);
+                        void (*plain_handler)(void);
+                        void *arg;
+                        bool autoreload;
+                        {
+                            std::lock_guard<std::mutex> lock(timer->mutex);
+                            if (timer->generation != generation)
+                            {
+                                return;
+                            }
+                            handler = timer->handler;
+                            plain_handler = timer->plain_handler;
+                            arg = timer->arg;
+                            autoreload = timer->autoreload;
+                        }
+                        {
+                            sim::IsrScope isr;
+                            if (handler)
+                            {
+                                handler(arg);
+                            }
+                            else if (plain_handler)
+                            {
+                                plain_handler();
+                            }
+                        }
+                        if (!autoreload)
+                        {
+                            return;
+                        }
+                    } })
+        .detach();
+}
@@ -0,0 +1,173 @@
+/*
+ * Logging, timers, system and network stubs. The simulated station is
+ * always associated, so wifi_init_sta() from main/src/wifi.cpp is replaced
+ * by a function that returns immediately.
+ */
+
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+#include "wifi.hpp"
+#include "sim.hpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+
+namespace
+{
+    const auto start_time = std::chrono::steady_clock::now();
+
+    std::mutex log_mutex;
+    std::map<std::string, esp_log_level_t> log_levels;
+    esp_log_level_t default_log_level = ESP_LOG_INFO;
+
+    esp_log_level_t levelFor(const char *tag)
+    {
+        auto it = log_levels.find(tag);
+        return it == log_levels.end() ? default_log_level : it->second;
+    }
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (std::strcmp(tag, "*") == 0)
+    {
+        default_log_level = level;
+        log_levels.clear();
+        return;
+    }
+    log_levels[tag] = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    sim::heap::Untracked untracked;
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (level > levelFor(tag))
+    {
+        return;
+    }
+    std::fprintf(stderr, "%c (%lld) %s: ", letters[level],
+                 static_cast<long long>(esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    std::vfprintf(stderr, format, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start_time)
+        .count();
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start_time)
+               .count() *
+           240 / 1000;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 256 * 1024;
+}
+
+uint32_t esp_random(void)
+{
+    static std::mutex mutex;
+    static std::minstd_rand generator(0x5eed);
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<uint32_t>(generator()) ^ (static_cast<uint32_t>(generator()) << 16);
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void esp_restart(void)
+{
+    std::fprintf(stderr, "esp_restart() called, exiting simulator\n");
+    std::exit(0);
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    std::memset(ap_info, 0, sizeof(*ap_info));
+    std::strncpy(reinterpret_cast<char *>(ap_info->ssid), CONFIG_WIFI_SSID, sizeof(ap_info->ssid) - 1);
+    ap_info->rssi = -40;
+    return ESP_OK;
+}
+
+void wifi_init_sta(void)
+{
+    ESP_LOGI("wifi", "connected to ap SSID:%s", CONFIG_WIFI_SSID);
+}
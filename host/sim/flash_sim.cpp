@@ -0,0 +1,252 @@
+/*
+ * SPI flash partitions backed by an image file. The partition table is
+ * read from partitions.csv (ROBOHAND_PARTITION_TABLE), the image is
+ * $ROBOHAND_FLASH_IMAGE or robohand-flash.bin in the working directory and
+ * keeps its contents across simulator runs, like flash across resets.
+ */
+
+#include "esp_partition.h"
+#include "sim.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint32_t kSectorSize = 4096;
+
+    std::mutex mutex;
+    bool loaded = false;
+    // deque: partitions are handed out by pointer
+    std::deque<esp_partition_t> partitions;
+    int image = -1;
+
+    std::atomic<uint64_t> erases{0};
+    std::atomic<uint64_t> bytes_written{0};
+
+    std::string trim(const std::string &value)
+    {
+        size_t begin = value.find_first_not_of(" \t\r");
+        size_t end = value.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : value.substr(begin, end - begin + 1);
+    }
+
+    // 0x1000, 4096, 4K, 1M
+    uint32_t parseSize(const std::string &value)
+    {
+        char *end;
+        unsigned long result = std::strtoul(value.c_str(), &end, 0);
+        if (*end == 'K' || *end == 'k')
+        {
+            result *= 1024;
+        }
+        else if (*end == 'M' || *end == 'm')
+        {
+            result *= 1024 * 1024;
+        }
+        return result;
+    }
+
+    uint32_t parseType(const std::string &value)
+    {
+        if (value == "app")
+        {
+            return ESP_PARTITION_TYPE_APP;
+        }
+        if (value == "data")
+        {
+            return ESP_PARTITION_TYPE_DATA;
+        }
+        return parseSize(value);
+    }
+
+    uint32_t parseSubtype(const std::string &value)
+    {
+        if (value == "factory")
+        {
+            return ESP_PARTITION_SUBTYPE_APP_FACTORY;
+        }
+        if (value == "phy")
+        {
+            return ESP_PARTITION_SUBTYPE_DATA_PHY;
+        }
+        if (value == "nvs")
+        {
+            return ESP_PARTITION_SUBTYPE_DATA_NVS;
+        }
+        return parseSize(value);
+    }
+
+    void load()
+    {
+        loaded = true;
+        std::ifstream table(ROBOHAND_PARTITION_TABLE);
+        if (!table)
+        {
+            std::fprintf(stderr, "flash_sim: cannot read %s\n", ROBOHAND_PARTITION_TABLE);
+            return;
+        }
+
+        // the partition table itself sits at 0x8000
+        uint32_t next_offset = 0x9000;
+        std::string line;
+        while (std::getline(table, line))
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::vector<std::string> fields;
+            std::stringstream stream(line);
+            std::string field;
+            while (std::getline(stream, field, ','))
+            {
+                fields.push_back(trim(field));
+            }
+            if (fields.size() < 5)
+            {
+                continue;
+            }
+
+            esp_partition_t partition = {};
+            std::strncpy(partition.label, fields[0].c_str(), sizeof(partition.label) - 1);
+            partition.type = static_cast<esp_partition_type_t>(parseType(fields[1]));
+            partition.subtype = static_cast<esp_partition_subtype_t>(parseSubtype(fields[2]));
+            uint32_t align = partition.type == ESP_PARTITION_TYPE_APP ? 0x10000 : kSectorSize;
+            partition.address = fields[3].empty() ? (next_offset + align - 1) / align * align : parseSize(fields[3]);
+            partition.size = parseSize(fields[4]);
+            partition.erase_size = kSectorSize;
+            next_offset = partition.address + partition.size;
+            partitions.push_back(partition);
+        }
+
+        const char *path = std::getenv("ROBOHAND_FLASH_IMAGE");
+        path = path ? path : "robohand-flash.bin";
+        image = open(path, O_RDWR | O_CREAT, 0644);
+        if (image < 0)
+        {
+            std::fprintf(stderr, "flash_sim: cannot open %s\n", path);
+            return;
+        }
+        // a new image is erased flash
+        off_t size = lseek(image, 0, SEEK_END);
+        if (size < off_t(next_offset))
+        {
+            std::vector<uint8_t> erased(next_offset - size, 0xFF);
+            if (pwrite(image, erased.data(), erased.size(), size) != ssize_t(erased.size()))
+            {
+                std::fprintf(stderr, "flash_sim: cannot extend %s\n", path);
+            }
+        }
+    }
+
+    bool inRange(const esp_partition_t *partition, size_t offset, size_t size)
+    {
+        return partition != nullptr && image >= 0 && offset <= partition->size && size <= partition->size - offset;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    sim::heap::Untracked untracked;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded)
+    {
+        load();
+    }
+    for (auto &partition : partitions)
+    {
+        if ((type == ESP_PARTITION_TYPE_ANY || partition.type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == subtype) &&
+            (label == nullptr || std::strcmp(partition.label, label) == 0))
+        {
+            return &partition;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!inRange(partition, src_offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (pread(image, dst, size, partition->address + src_offset) != ssize_t(size))
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    sim::heap::Untracked untracked;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!inRange(partition, dst_offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // programming only clears bits
+    std::vector<uint8_t> data(size);
+    if (pread(image, data.data(), size, partition->address + dst_offset) != ssize_t(size))
+    {
+        return ESP_FAIL;
+    }
+    auto *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] &= bytes[i];
+    }
+    if (pwrite(image, data.data(), size, partition->address + dst_offset) != ssize_t(size))
+    {
+        return ESP_FAIL;
+    }
+    bytes_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    sim::heap::Untracked untracked;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!inRange(partition, offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % kSectorSize != 0 || size % kSectorSize != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::vector<uint8_t> erased(size, 0xFF);
+    if (pwrite(image, erased.data(), size, partition->address + offset) != ssize_t(size))
+    {
+        return ESP_FAIL;
+    }
+    erases += size / kSectorSize;
+    return ESP_OK;
+}
+
+uint64_t sim::flash::erases()
+{
+    return ::erases.load();
+}
+
+uint64_t sim::flash::bytesWritten()
+{
+    return ::bytes_written.load();
+}
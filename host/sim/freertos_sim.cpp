@@ -0,0 +1,456 @@
+/*
+ * FreeRTOS on top of std::thread. Priorities and core affinity are ignored,
+ * tasks are preemptively scheduled by the host OS.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "sim.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct tskTaskControlBlock
+{
+    std::string name;
+    TaskFunction_t code;
+    void *parameters;
+    // direct to task notification, used as a counting semaphore
+    std::mutex notify_mutex{};
+    std::condition_variable notified{};
+    uint32_t notify_value = 0;
+};
+
+struct QueueDefinition
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+};
+
+struct tmrTimerControl
+{
+    std::string name;
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool active = false;
+    std::chrono::steady_clock::time_point expiry{};
+};
+
+struct EventGroupDef_t
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const Clock::time_point start_time = Clock::now();
+    thread_local tskTaskControlBlock *current_task = nullptr;
+    thread_local int isr_depth = 0;
+
+    Clock::duration ticksToDuration(TickType_t ticks)
+    {
+        return std::chrono::microseconds(uint64_t(ticks) * 1000000 / configTICK_RATE_HZ);
+    }
+
+    Clock::time_point deadline(TickType_t ticks)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            return Clock::time_point::max();
+        }
+        return Clock::now() + ticksToDuration(ticks);
+    }
+}
+
+sim::IsrScope::IsrScope()
+{
+    isr_depth++;
+}
+
+sim::IsrScope::~IsrScope()
+{
+    isr_depth--;
+}
+
+BaseType_t xPortInIsrContext(void)
+{
+    return isr_depth > 0 ? pdTRUE : pdFALSE;
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    while (mux->locked.exchange(true, std::memory_order_acquire))
+    {
+        std::this_thread::yield();
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    mux->locked.store(false, std::memory_order_release);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName,
+                                   uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    tskTaskControlBlock *task;
+    {
+        sim::heap::Untracked untracked;
+        task = new tskTaskControlBlock{pcName ? pcName : "", pxTaskCode, pvParameters};
+        std::thread([task]()
+                    {
+                        current_task = task;
+                        sim::heap::attachTask(task->name.c_str());
+                        task->code(task->parameters); })
+            .detach();
+    }
+    if (pxCreatedTask)
+    {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority,
+                                   pxCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    // Only self deletion is supported, the thread simply parks forever
+    if (xTaskToDelete == nullptr || xTaskToDelete == current_task)
+    {
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    {
+        std::lock_guard<std::mutex> lock(xTaskToNotify->notify_mutex);
+        xTaskToNotify->notify_value++;
+    }
+    xTaskToNotify->notified.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    tskTaskControlBlock *task = current_task;
+    assert(task != nullptr && "ulTaskNotifyTake outside of a task");
+    std::unique_lock<std::mutex> lock(task->notify_mutex);
+    task->notified.wait_until(lock, deadline(xTicksToWait), [task]()
+                              { return task->notify_value != 0; });
+    uint32_t value = task->notify_value;
+    if (value != 0)
+    {
+        task->notify_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    std::this_thread::sleep_for(ticksToDuration(xTicksToDelay));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement)
+{
+    *pxPreviousWakeTime += xTimeIncrement;
+    auto wake = start_time + ticksToDuration(*pxPreviousWakeTime);
+    if (wake <= Clock::now())
+    {
+        return pdFALSE;
+    }
+    std::this_thread::sleep_until(wake);
+    return pdTRUE;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time);
+    return TickType_t(uint64_t(elapsed.count()) * configTICK_RATE_HZ / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task;
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    tskTaskControlBlock *task = xTaskToQuery ? xTaskToQuery : current_task;
+    return task ? task->name.c_str() : "main";
+}
+
+void vTaskYield(void)
+{
+    std::this_thread::yield();
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    auto *queue = new QueueDefinition;
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete xQueue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xQueue->mutex);
+    if (!xQueue->changed.wait_until(lock, deadline(xTicksToWait), [xQueue]()
+                                    { return xQueue->items.size() < xQueue->length; }))
+    {
+        return errQUEUE_FULL;
+    }
+    auto *bytes = static_cast<const uint8_t *>(pvItemToQueue);
+    // FreeRTOS copies into storage allocated by xQueueCreate
+    sim::heap::Untracked untracked;
+    xQueue->items.emplace_back(bytes, bytes + xQueue->item_size);
+    xQueue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue,
+                             BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+    {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xQueue->mutex);
+    if (!xQueue->changed.wait_until(lock, deadline(xTicksToWait), [xQueue]()
+                                    { return !xQueue->items.empty(); }))
+    {
+        return errQUEUE_EMPTY;
+    }
+    std::memcpy(pvBuffer, xQueue->items.front().data(), xQueue->item_size);
+    xQueue->items.pop_front();
+    xQueue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->items.size();
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return new EventGroupDef_t;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    delete xEventGroup;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    std::lock_guard<std::mutex> lock(xEventGroup->mutex);
+    xEventGroup->bits |= uxBitsToSet;
+    xEventGroup->changed.notify_all();
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    std::lock_guard<std::mutex> lock(xEventGroup->mutex);
+    EventBits_t bits = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit, const BaseType_t xWaitForAllBits,
+                                TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xEventGroup->mutex);
+    auto satisfied = [&]()
+    {
+        EventBits_t set = xEventGroup->bits & uxBitsToWaitFor;
+        return xWaitForAllBits ? set == uxBitsToWaitFor : set != 0;
+    };
+    bool ok = xEventGroup->changed.wait_until(lock, deadline(xTicksToWait), satisfied);
+    EventBits_t bits = xEventGroup->bits;
+    if (ok && xClearOnExit)
+    {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    return bits;
+}
+
+namespace
+{
+    std::mutex timers_mutex;
+    std::condition_variable timers_changed;
+    std::vector<tmrTimerControl *> timers;
+    bool timer_service_started = false;
+
+    // The FreeRTOS daemon task: runs expired timer callbacks one by one
+    void timerService(void *)
+    {
+        std::unique_lock<std::mutex> lock(timers_mutex);
+        for (;;)
+        {
+            tmrTimerControl *next = nullptr;
+            for (auto *timer : timers)
+            {
+                if (timer->active && (!next || timer->expiry < next->expiry))
+                {
+                    next = timer;
+                }
+            }
+            if (!next)
+            {
+                timers_changed.wait(lock);
+                continue;
+            }
+            if (timers_changed.wait_until(lock, next->expiry) == std::cv_status::no_timeout)
+            {
+                // timers changed, look again
+                continue;
+            }
+            if (!next->active || Clock::now() < next->expiry)
+            {
+                continue;
+            }
+            if (next->auto_reload)
+            {
+                next->expiry += ticksToDuration(next->period);
+            }
+            else
+            {
+                next->active = false;
+            }
+            lock.unlock();
+            next->callback(next);
+            lock.lock();
+        }
+    }
+
+    BaseType_t startTimer(TimerHandle_t timer)
+    {
+        std::lock_guard<std::mutex> lock(timers_mutex);
+        timer->active = true;
+        timer->expiry = Clock::now() + ticksToDuration(timer->period);
+        timers_changed.notify_all();
+        return pdPASS;
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks,
+                           UBaseType_t uxAutoReload, void *pvTimerID,
+                           TimerCallbackFunction_t pxCallbackFunction)
+{
+    auto *timer = new tmrTimerControl{pcTimerName ? pcTimerName : "", xTimerPeriodInTicks,
+                                      uxAutoReload != 0, pvTimerID, pxCallbackFunction};
+    bool start_service;
+    {
+        std::lock_guard<std::mutex> lock(timers_mutex);
+        timers.push_back(timer);
+        start_service = !timer_service_started;
+        timer_service_started = true;
+    }
+    if (start_service)
+    {
+        xTaskCreate(timerService, "Tmr Svc", 2048, nullptr, 1, nullptr);
+    }
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return startTimer(xTimer);
+}
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    return startTimer(xTimer);
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    xTimer->active = false;
+    timers_changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+{
+    {
+        std::lock_guard<std::mutex> lock(timers_mutex);
+        xTimer->period = xNewPeriod;
+    }
+    return startTimer(xTimer);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return xTimer->active ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+{
+    // callbacks may still reference the timer, it is only deactivated
+    return xTimerStop(xTimer, xTicksToWait);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t xTimer)
+{
+    return xTimer->id;
+}
+
+const char *pcTimerGetName(TimerHandle_t xTimer)
+{
+    return xTimer->name.c_str();
+}
@@ -0,0 +1,172 @@
+/*
+ * Counts heap allocations (global operator new) per simulated task.
+ * Allocations made by the simulator itself are wrapped in
+ * sim::heap::Untracked and not counted, so the counters show what the
+ * firmware code allocates.
+ */
+
+#include "sim.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+    struct TaskCounter
+    {
+        std::string name;
+        std::atomic<uint64_t> allocations{0};
+    };
+
+    std::atomic<uint64_t> total{0};
+    thread_local TaskCounter *current_counter = nullptr;
+    thread_local int untracked_depth = 0;
+
+    std::mutex &countersMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    std::vector<TaskCounter *> &counters()
+    {
+        static std::vector<TaskCounter *> list;
+        return list;
+    }
+
+    void *allocate(size_t size, size_t alignment = 0)
+    {
+        if (untracked_depth == 0 && current_counter)
+        {
+            current_counter->allocations.fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+        }
+        size = size ? size : 1;
+        void *ptr = alignment > alignof(std::max_align_t)
+                        ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                        : std::malloc(size);
+        return ptr;
+    }
+}
+
+sim::heap::Untracked::Untracked()
+{
+    untracked_depth++;
+}
+
+sim::heap::Untracked::~Untracked()
+{
+    untracked_depth--;
+}
+
+void sim::heap::attachTask(const char *name)
+{
+    Untracked untracked;
+    auto *counter = new TaskCounter{name};
+    std::lock_guard<std::mutex> lock(countersMutex());
+    counters().push_back(counter);
+    current_counter = counter;
+}
+
+uint64_t sim::heap::allocations()
+{
+    return total.load();
+}
+
+std::vector<sim::heap::TaskAllocations> sim::heap::perTask()
+{
+    Untracked untracked;
+    std::vector<TaskAllocations> result;
+    std::lock_guard<std::mutex> lock(countersMutex());
+    for (auto *counter : counters())
+    {
+        result.push_back({counter->name, counter->allocations.load()});
+    }
+    return result;
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = allocate(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    void *ptr = allocate(size, size_t(alignment));
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+// every operator new above allocates with malloc, GCC cannot tell
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
@@ -0,0 +1,528 @@
+/*
+ * In-process MQTT broker standing in for esp-mqtt and a real broker.
+ * Every client owns an event task which calls the registered handlers in
+ * order, so handler code runs on a single thread as it does on target.
+ */
+
+#include "mqtt_client.h"
+#include "sim.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Handler
+    {
+        esp_mqtt_event_id_t event;
+        esp_event_handler_t function;
+        void *arg;
+    };
+
+    struct PendingEvent
+    {
+        esp_mqtt_event_id_t id;
+        std::string topic;
+        std::string data;
+        int msg_id;
+    };
+
+    std::atomic<uint64_t> publishes{0};
+    std::atomic<uint64_t> publish_bytes{0};
+    std::atomic<uint64_t> wire_bytes{0};
+    std::atomic<uint64_t> wire_packets{0};
+    std::atomic<uint64_t> subscribes{0};
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> handled{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<bool> broker_available{true};
+
+    // Time between a connect request and CONNACK from the simulated broker
+    constexpr auto kConnectLatency = std::chrono::milliseconds(5);
+    // One way latency to the broker, a SUBSCRIBE takes effect after it and
+    // is acknowledged after a round trip
+    constexpr auto kLinkLatency = std::chrono::milliseconds(2);
+    // esp_mqtt_client_subscribe/publish block the caller while the packet is written
+    constexpr auto kPacketWriteTime = std::chrono::microseconds(300);
+
+    std::mutex first_data_mutex;
+    std::vector<uint64_t> first_data_delays;
+
+    std::mutex observer_mutex;
+    sim::mqtt::PublishObserver publish_observer;
+}
+
+namespace
+{
+    int publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos);
+
+    struct OutboxEntry
+    {
+        std::string topic;
+        std::string data;
+        int qos;
+    };
+}
+
+struct esp_mqtt_client
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<PendingEvent> events;
+    std::vector<Handler> handlers;
+    std::vector<std::string> subscriptions;
+    // enqueued while offline, sent after the next CONNACK
+    std::deque<OutboxEntry> outbox;
+    std::string uri;
+    bool started = false;
+    bool connected = false;
+    // incremented on every CONNACK, late SUBSCRIBEs of an old session are ignored
+    uint32_t session = 0;
+    std::chrono::steady_clock::time_point connack_time;
+    bool awaiting_first_data = false;
+    int next_msg_id = 1;
+
+    void post(PendingEvent event)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::move(event));
+        changed.notify_one();
+    }
+
+    void postConnected()
+    {
+        connects++;
+        std::thread([this]()
+                    {
+                        std::this_thread::sleep_for(kConnectLatency);
+                        // esp-mqtt reports a failed attempt as a disconnect
+                        post({broker_available ? MQTT_EVENT_CONNECTED : MQTT_EVENT_DISCONNECTED, "", "", 0}); })
+            .detach();
+    }
+
+    int nextMsgId()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next_msg_id++;
+    }
+
+    void dispatch(PendingEvent &pending)
+    {
+        esp_mqtt_event_t event = {};
+        event.event_id = pending.id;
+        event.client = this;
+        event.topic = pending.topic.data();
+        event.topic_len = pending.topic.size();
+        event.data = pending.data.data();
+        event.data_len = pending.data.size();
+        event.total_data_len = pending.data.size();
+        event.msg_id = pending.msg_id;
+
+        std::vector<Handler> current;
+        {
+            sim::heap::Untracked untracked;
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.id == MQTT_EVENT_CONNECTED)
+            {
+                connected = true;
+                session++;
+                connack_time = std::chrono::steady_clock::now();
+                awaiting_first_data = true;
+            }
+            else if (pending.id == MQTT_EVENT_DATA && awaiting_first_data)
+            {
+                awaiting_first_data = false;
+                auto delay = std::chrono::steady_clock::now() - connack_time;
+                std::lock_guard<std::mutex> delays_lock(first_data_mutex);
+                first_data_delays.push_back(
+                    std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+            }
+            else if (pending.id == MQTT_EVENT_DISCONNECTED)
+            {
+                connected = false;
+                subscriptions.clear();
+            }
+            current = handlers;
+        }
+        for (auto &handler : current)
+        {
+            if (handler.event == MQTT_EVENT_ANY || handler.event == pending.id)
+            {
+                handler.function(handler.arg, "MQTT_EVENTS", pending.id, &event);
+            }
+        }
+        if (pending.id == MQTT_EVENT_DATA)
+        {
+            handled++;
+        }
+        else if (pending.id == MQTT_EVENT_CONNECTED)
+        {
+            flushOutbox();
+        }
+    }
+
+    void flushOutbox()
+    {
+        sim::heap::Untracked untracked;
+        std::deque<OutboxEntry> stored;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stored.swap(outbox);
+        }
+        for (auto &entry : stored)
+        {
+            publish(this, entry.topic.c_str(), entry.data.data(), entry.data.size(), entry.qos);
+        }
+    }
+
+    void run()
+    {
+        // esp-mqtt dispatches events from its own task
+        sim::heap::attachTask("mqtt_task");
+        for (;;)
+        {
+            PendingEvent pending;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]()
+                             { return !events.empty(); });
+                pending = std::move(events.front());
+                events.pop_front();
+            }
+            dispatch(pending);
+        }
+    }
+};
+
+namespace
+{
+    std::mutex clients_mutex;
+    std::vector<esp_mqtt_client *> clients;
+
+    // PUBLISH packet size: fixed header, topic, packet id for QoS > 0, payload
+    size_t publishWireSize(size_t topic_len, size_t payload_len, int qos)
+    {
+        size_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + payload_len;
+        size_t length_bytes = 1;
+        for (size_t left = remaining >> 7; left; left >>= 7)
+        {
+            length_bytes++;
+        }
+        return 1 + length_bytes + remaining;
+    }
+
+    int publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos)
+    {
+        // outbox and delivery belong to esp-mqtt, not to the firmware
+        sim::heap::Untracked untracked;
+        {
+            std::lock_guard<std::mutex> lock(client->mutex);
+            if (!client->connected)
+            {
+                return -1;
+            }
+        }
+        if (len == 0 && data != nullptr)
+        {
+            len = std::strlen(data);
+        }
+        // QoS 1 adds PUBACK, QoS 2 PUBREC, PUBREL and PUBCOMP, 4 bytes each
+        int acks = qos == 1 ? 1 : qos == 2 ? 3 : 0;
+        publishes++;
+        publish_bytes += len;
+        wire_bytes += publishWireSize(std::strlen(topic), len, qos) + 4 * acks;
+        wire_packets += 1 + acks;
+        std::string payload(data ? data : "", len);
+        {
+            std::lock_guard<std::mutex> lock(observer_mutex);
+            if (publish_observer)
+            {
+                publish_observer(topic, payload);
+            }
+        }
+        sim::mqtt::inject(topic, payload);
+        int msg_id = qos > 0 ? client->nextMsgId() : 0;
+        if (qos > 0)
+        {
+            // PUBACK after one round trip, PUBCOMP after two
+            std::thread([client, msg_id, qos]()
+                        {
+                            std::this_thread::sleep_for(2 * qos * kLinkLatency);
+                            client->post({MQTT_EVENT_PUBLISHED, "", "", msg_id}); })
+                .detach();
+        }
+        return msg_id;
+    }
+}
+
+bool sim::mqtt::topicMatches(const std::string &filter, const std::string &topic)
+{
+    auto split = [](const std::string &value)
+    {
+        std::vector<std::string> levels;
+        size_t begin = 0;
+        for (;;)
+        {
+            size_t end = value.find('/', begin);
+            levels.push_back(value.substr(begin, end - begin));
+            if (end == std::string::npos)
+            {
+                return levels;
+            }
+            begin = end + 1;
+        }
+    };
+
+    auto filter_levels = split(filter);
+    auto topic_levels = split(topic);
+    for (size_t i = 0; i < filter_levels.size(); i++)
+    {
+        if (filter_levels[i] == "#")
+        {
+            // "a/#" also matches the parent level "a"
+            return true;
+        }
+        if (i >= topic_levels.size())
+        {
+            return false;
+        }
+        if (filter_levels[i] != "+" && filter_levels[i] != topic_levels[i])
+        {
+            return false;
+        }
+    }
+    return filter_levels.size() == topic_levels.size();
+}
+
+void sim::mqtt::inject(const std::string &topic, const std::string &payload)
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto *client : clients)
+    {
+        bool matches = false;
+        {
+            std::lock_guard<std::mutex> client_lock(client->mutex);
+            for (auto &filter : client->subscriptions)
+            {
+                if (topicMatches(filter, topic))
+                {
+                    matches = true;
+                    break;
+                }
+            }
+        }
+        if (matches)
+        {
+            delivered++;
+            client->post({MQTT_EVENT_DATA, topic, payload, 0});
+        }
+    }
+}
+
+std::vector<uint64_t> sim::mqtt::firstDataDelays()
+{
+    sim::heap::Untracked untracked;
+    std::lock_guard<std::mutex> lock(first_data_mutex);
+    return first_data_delays;
+}
+
+void sim::mqtt::dropConnections()
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto *client : clients)
+    {
+        client->post({MQTT_EVENT_DISCONNECTED, "", "", 0});
+    }
+}
+
+void sim::mqtt::setPublishObserver(PublishObserver observer)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex);
+    publish_observer = std::move(observer);
+}
+
+void sim::mqtt::setBrokerAvailable(bool available)
+{
+    broker_available = available;
+}
+
+sim::mqtt::Stats sim::mqtt::stats()
+{
+    return {publishes.load(), publish_bytes.load(), wire_bytes.load(), wire_packets.load(), subscribes.load(),
+            delivered.load(), handled.load(), connects.load()};
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    auto *client = new esp_mqtt_client;
+    client->uri = config->broker.address.uri ? config->broker.address.uri : "";
+    std::thread([client]()
+                { client->run(); })
+        .detach();
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    clients.push_back(client);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        if (client->started)
+        {
+            return ESP_FAIL;
+        }
+        client->started = true;
+    }
+    client->postConnected();
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->started = false;
+    }
+    client->post({MQTT_EVENT_DISCONNECTED, "", "", 0});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    client->postConnected();
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    client->post({MQTT_EVENT_DISCONNECTED, "", "", 0});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    // The event task keeps a pointer to the client, it is never freed
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    std::erase(clients, client);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void *event_handler_arg)
+{
+    std::lock_guard<std::mutex> lock(client->mutex);
+    client->handlers.push_back({event, event_handler, event_handler_arg});
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_unregister_event(esp_mqtt_client_handle_t client,
+                                           esp_mqtt_event_id_t event,
+                                           esp_event_handler_t event_handler)
+{
+    std::lock_guard<std::mutex> lock(client->mutex);
+    std::erase_if(client->handlers, [&](const Handler &handler)
+                  { return handler.event == event && handler.function == event_handler; });
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    int msg_id;
+    uint32_t session;
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        if (!client->connected)
+        {
+            return -1;
+        }
+        msg_id = client->next_msg_id++;
+        session = client->session;
+    }
+    subscribes++;
+    std::this_thread::sleep_for(kPacketWriteTime);
+
+    sim::heap::Untracked untracked;
+    std::thread([client, filter = std::string(topic), msg_id, session]()
+                {
+                    std::this_thread::sleep_for(kLinkLatency);
+                    {
+                        std::lock_guard<std::mutex> lock(client->mutex);
+                        if (!client->connected || client->session != session)
+                        {
+                            return;
+                        }
+                        client->subscriptions.push_back(filter);
+                    }
+                    std::this_thread::sleep_for(kLinkLatency);
+                    {
+                        std::lock_guard<std::mutex> lock(client->mutex);
+                        if (client->session != session)
+                        {
+                            return;
+                        }
+                    }
+                    client->post({MQTT_EVENT_SUBSCRIBED, "", "", msg_id}); })
+        .detach();
+    return msg_id;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
+{
+    int msg_id;
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        std::erase(client->subscriptions, std::string(topic));
+        msg_id = client->next_msg_id++;
+    }
+    client->post({MQTT_EVENT_UNSUBSCRIBED, "", "", msg_id});
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain)
+{
+    std::this_thread::sleep_for(kPacketWriteTime);
+    return publish(client, topic, data, len, qos);
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain, bool store)
+{
+    int msg_id = publish(client, topic, data, len, qos);
+    if (msg_id >= 0 || !store)
+    {
+        return msg_id;
+    }
+    // esp-mqtt keeps stored messages in the outbox while offline
+    sim::heap::Untracked untracked;
+    if (len == 0 && data != nullptr)
+    {
+        len = std::strlen(data);
+    }
+    {
+        std::lock_guard<std::mutex> lock(client->mutex);
+        client->outbox.push_back({topic, std::string(data ? data : "", len), qos});
+    }
+    return client->nextMsgId();
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    std::lock_guard<std::mutex> lock(client->mutex);
+    int size = 0;
+    for (auto &entry : client->outbox)
+    {
+        size += entry.topic.size() + entry.data.size();
+    }
+    return size;
+}
@@ -0,0 +1,124 @@
+/*
+ * In-memory NVS. Contents do not survive a simulator restart.
+ */
+
+#include "nvs_flash.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::mutex mutex;
+    bool initialized = false;
+    std::vector<std::string> namespaces;
+    std::map<std::string, std::vector<uint8_t>> entries;
+
+    bool validHandle(nvs_handle_t handle)
+    {
+        return handle > 0 && handle <= namespaces.size();
+    }
+
+    std::string entryKey(nvs_handle_t handle, const char *key)
+    {
+        return namespaces[handle - 1] + "/" + key;
+    }
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!initialized)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    namespaces.emplace_back(name);
+    *out_handle = namespaces.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return validHandle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!validHandle(handle))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    auto *bytes = static_cast<const uint8_t *>(value);
+    entries[entryKey(handle, key)] = std::vector<uint8_t>(bytes, bytes + length);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!validHandle(handle))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    auto it = entries.find(entryKey(handle, key));
+    if (it == entries.end())
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == nullptr)
+    {
+        *length = it->second.size();
+        return ESP_OK;
+    }
+    if (*length < it->second.size())
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    std::memcpy(out_value, it->second.data(), it->second.size());
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return nvs_get_blob(handle, key, out_value, &length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!validHandle(handle))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    return entries.erase(entryKey(handle, key)) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
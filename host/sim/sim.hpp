@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * Host-only simulator controls. Firmware code never includes this header,
+ * it is used by host/main.cpp to drive the simulated hardware and broker.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+    /**
+     * @brief Marks the current thread as running an interrupt handler
+     * for as long as the scope lives (xPortInIsrContext() returns true)
+     */
+    class IsrScope
+    {
+    public:
+        IsrScope();
+        ~IsrScope();
+        IsrScope(const IsrScope &) = delete;
+        IsrScope &operator=(const IsrScope &) = delete;
+    };
+
+    namespace gpio
+    {
+        using AnalogSource = std::function<uint16_t(uint8_t pin)>;
+
+        int level(uint8_t pin);
+        void setLevel(uint8_t pin, int level);
+        void setAnalog(uint8_t pin, uint16_t value);
+        // Overrides setAnalog values, e.g. to model a multiplexer in front of the ADC
+        void setAnalogSource(AnalogSource source);
+        // Input of an ADC pin, 12 bit, the source if one is set
+        uint16_t analog(uint8_t pin);
+        uint32_t ledcDuty(uint8_t pin);
+        // Output writes: digitalWrite calls and GPIO_OUT register writes
+        uint64_t writes();
+        // GPIO_OUT register writes (REG_WRITE) alone
+        uint64_t registerWrites();
+        using RegisterObserver = std::function<void(uint32_t reg, uint32_t value)>;
+        // Called for every register write, from the writing thread
+        void setRegisterObserver(RegisterObserver observer);
+    }
+
+    namespace adc
+    {
+        struct Stats
+        {
+            uint64_t conversions;
+            uint64_t frames;
+            uint64_t lost_frames; // the simulator fell that far behind, skipped like overwritten DMA buffers
+            uint64_t late_conversions; // converted before the conversion done callback of the previous frame returned
+        };
+
+        // RC time constant of every ADC input in continuous mode, us: after a
+        // change it moves towards the new value by exp(-t / tau). 0 - instant
+        void setSettleTime(double tau_us);
+        Stats stats();
+    }
+
+    namespace mqtt
+    {
+        struct Stats
+        {
+            uint64_t publishes;
+            uint64_t publish_bytes;
+            uint64_t wire_bytes;   // whole PUBLISH packets and their acknowledgements
+            uint64_t wire_packets; // PUBLISH packets and their acknowledgements
+            uint64_t subscribes;
+            uint64_t delivered;
+            uint64_t handled; // MQTT_EVENT_DATA events returned from the handlers
+            uint64_t connects;
+        };
+
+        // Delivers a message to every client subscribed to a matching topic
+        void inject(const std::string &topic, const std::string &payload);
+        // Drops every client connection (MQTT_EVENT_DISCONNECTED)
+        void dropConnections();
+        // While unavailable every connect attempt fails (MQTT_EVENT_DISCONNECTED)
+        void setBrokerAvailable(bool available);
+        using PublishObserver = std::function<void(const std::string &topic, const std::string &payload)>;
+        // Called for every publish that reaches the broker, from the publishing thread
+        void setPublishObserver(PublishObserver observer);
+        bool topicMatches(const std::string &filter, const std::string &topic);
+        // Time from every CONNACK to the first MQTT_EVENT_DATA after it, us
+        std::vector<uint64_t> firstDataDelays();
+        Stats stats();
+    }
+
+    namespace flash
+    {
+        // Sectors erased and bytes programmed through esp_partition_*
+        uint64_t erases();
+        uint64_t bytesWritten();
+    }
+
+    namespace heap
+    {
+        struct TaskAllocations
+        {
+            std::string name;
+            uint64_t allocations;
+        };
+
+        /**
+         * @brief Allocations made while the scope lives are not counted,
+         * used by the simulator for its own bookkeeping
+         */
+        class Untracked
+        {
+        public:
+            Untracked();
+            ~Untracked();
+            Untracked(const Untracked &) = delete;
+            Untracked &operator=(const Untracked &) = delete;
+        };
+
+        // Counts allocations of the calling thread under the task name
+        void attachTask(const char *name);
+        // Allocations made by firmware code in tasks
+        uint64_t allocations();
+        std::vector<TaskAllocations> perTask();
+    }
+}
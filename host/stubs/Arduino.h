@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * Host replacement for the subset of the Arduino-fork core used by the
+ * firmware. Pin levels, ADC readings and LEDC duties live in the simulator
+ * (see host/sim/arduino_sim.cpp and host/sim/sim.hpp).
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ARDUINO_ISR_ATTR IRAM_ATTR
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+uint16_t analogRead(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void analogWrite(uint8_t pin, int value);
+
+bool ledcAttach(uint8_t pin, uint32_t freq, uint8_t resolution);
+bool ledcWrite(uint8_t pin, uint32_t duty);
+uint32_t ledcRead(uint8_t pin);
+bool ledcDetach(uint8_t pin);
+
+unsigned long micros();
+unsigned long millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// General purpose timers, alarms call the handler in a simulated interrupt
+struct timer_struct_t;
+typedef struct timer_struct_t hw_timer_t;
+
+hw_timer_t *timerBegin(uint32_t frequency);
+void timerEnd(hw_timer_t *timer);
+void timerAttachInterrupt(hw_timer_t *timer, void (*userFunc)(void));
+void timerAttachInterruptArg(hw_timer_t *timer, void (*userFunc)(void *), void *arg);
+void timerAlarm(hw_timer_t *timer, uint64_t alarm_value, bool autoreload, uint64_t reload_count);
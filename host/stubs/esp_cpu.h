@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/**
+ * @brief Time since simulator start in cycles of a 240 MHz core
+ */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, reflected), esp_rom_crc32_le(0, buf, len) is the usual crc32
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_random.h"
+
+uint32_t esp_get_free_heap_size(void);
+void esp_restart(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Microseconds since simulator start
+ */
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_FULL ((BaseType_t)0)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) \
+    ((TickType_t)(((uint64_t)(xTimeInMs) * (uint64_t)configTICK_RATE_HZ) / (uint64_t)1000U))
+#define pdTICKS_TO_MS(xTicks) \
+    ((TickType_t)(((uint64_t)(xTicks) * (uint64_t)1000U) / (uint64_t)configTICK_RATE_HZ))
+
+#define configASSERT(x) assert(x)
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+/**
+ * @brief true while the calling thread runs a simulated interrupt handler
+ */
+BaseType_t xPortInIsrContext(void);
+
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+/**
+ * @brief Spinlock of a critical section, interrupts are not masked on the host
+ */
+typedef struct
+{
+    std::atomic<bool> locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {false}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+struct tmrTimerControl;
+typedef struct tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t xTimer);
+
+/*
+ * Software timers. Callbacks run one at a time on a simulated timer
+ * service task, like the FreeRTOS daemon task. Commands take effect
+ * immediately, xTicksToWait is ignored.
+ */
+TimerHandle_t xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks,
+                           UBaseType_t uxAutoReload, void *pvTimerID,
+                           TimerCallbackFunction_t pxCallbackFunction);
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait);
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait);
+// Changes the period and starts the timer
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer);
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait);
+void *pvTimerGetTimerID(TimerHandle_t xTimer);
+const char *pcTimerGetName(TimerHandle_t xTimer);
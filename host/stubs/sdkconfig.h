@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+ * Host build configuration. Mirrors the defaults from main/Kconfig.projbuild,
+ * keep both in sync when adding options.
+ */
+
+#define CONFIG_IDF_TARGET "esp32s3"
+#define CONFIG_IDF_TARGET_ESP32S3 1
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_FREERTOS_NUMBER_OF_CORES 2
+
+#define CONFIG_MAC "D7:BB:3E:DC:B4:37"
+#define CONFIG_UUID "98e0e56d-7d76-42a5-8206-e7d44ab985e6"
+
+#define CONFIG_WIFI_SSID "wifi"
+#define CONFIG_WIFI_PASSWORD "password"
+#define CONFIG_WIFI_RECONNECT_TIMEOUT 2000
+#define CONFIG_WIFI_SECURITY_STANDART 3
+#define CONFIG_WIFI_MAXIMUM_CONNECT_RETRY 10
+
+#define CONFIG_MQTT_BROKER_ADDRESS "mqtt://192.168.0.107:1883"
+#define CONFIG_MQTT_BROKER_USER_NAME "admin"
+#define CONFIG_MQTT_BROKER_PASSWORD "public"
+#define CONFIG_MQTT_KEEP_ALIVE_TIME 60
+#define CONFIG_MQTT_QOS_TELEMETRY 0
+/* #undef CONFIG_MQTT_RETAIN_TELEMETRY */
+#define CONFIG_MQTT_QOS_STATE 1
+#define CONFIG_MQTT_RETAIN_STATE 1
+#define CONFIG_MQTT_QOS_NOTIFICATIONS 1
+/* #undef CONFIG_MQTT_RETAIN_NOTIFICATIONS */
+#define CONFIG_MQTT_QOS_COMMANDS 1
+#define CONFIG_MQTT_RECONNECT_BACKOFF_MIN_MS 250
+#define CONFIG_MQTT_RECONNECT_BACKOFF_MAX_MS 30000
+#define CONFIG_MQTT_CONTROL_MAX_INFLIGHT 8
+#define CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S 65536
+#define CONFIG_MQTT_LANE_REPORT_PERIOD 60
+
+#define CONFIG_MIDDLEWARE_SENDING_STATE_PERIOD 500
+/* #undef CONFIG_MIDDLEWARE_PER_SENSOR_TOPICS */
+#define CONFIG_MIDDLEWARE_DELTA_FRAMES 1
+#define CONFIG_MIDDLEWARE_KEYFRAME_INTERVAL 20
+#define CONFIG_MIDDLEWARE_DEADBAND_IMU_MILLI 20
+#define CONFIG_MIDDLEWARE_DEADBAND_POTENTIOMETER 1
+#define CONFIG_MIDDLEWARE_DEADBAND_STRAIN_GAUGE 5
+#define CONFIG_MIDDLEWARE_DEADBAND_SERVO 0
+/* #undef CONFIG_MIDDLEWARE_HIGH_RATE */
+#define CONFIG_MIDDLEWARE_SAMPLE_RATE_HZ 200
+#define CONFIG_MIDDLEWARE_SAMPLES_PER_FRAME 10
+#define CONFIG_MIDDLEWARE_RATE_REPORT_PERIOD 10
+#define CONFIG_MIDDLEWARE_SPOOL 1
+#define CONFIG_MIDDLEWARE_SPOOL_PARTITION "spool"
+#define CONFIG_MIDDLEWARE_SPOOL_REPLAY_PER_PERIOD 4
+
+/* telemetry lane defaults depend on the middleware mode above */
+#if defined(CONFIG_MIDDLEWARE_PER_SENSOR_TOPICS)
+#define CONFIG_MQTT_TELEMETRY_LANE_DEPTH 64
+#elif defined(CONFIG_MIDDLEWARE_HIGH_RATE)
+#define CONFIG_MQTT_TELEMETRY_LANE_DEPTH 8
+#else
+#define CONFIG_MQTT_TELEMETRY_LANE_DEPTH 16
+#endif
+#ifdef CONFIG_MIDDLEWARE_HIGH_RATE
+#define CONFIG_MQTT_TELEMETRY_SLOT_SIZE 2048
+#else
+#define CONFIG_MQTT_TELEMETRY_SLOT_SIZE 512
+#endif
+
+#define CONFIG_COMMANDS_QUEUE_CAPACITY 32
+#define CONFIG_COMMANDS_COALESCE 1
+#define CONFIG_COMMANDS_ARENA_SIZE 512
+/* #undef CONFIG_COMMANDS_DEBUG_DUMP */
+
+#define CONFIG_CONTROL_RATE_HZ 500
+#define CONFIG_CONTROL_CORE 1
+#define CONFIG_CONTROL_COMMAND_DEADLINE_MS 200
+#define CONFIG_CONTROL_GESTURE_DURATION_MS 500
+#define CONFIG_TRAJECTORY_MAX_SAMPLES 128
+#define CONFIG_GESTURES_PARTITION "gestures"
+#define CONFIG_GESTURES_MAX_TABLE_SIZE 4096
+#define CONFIG_CONTROL_MAX_SPEED_DEG_S 90
+#define CONFIG_CONTROL_PRESSURE_KP_MILLI 20
+#define CONFIG_CONTROL_PRESSURE_KI_MILLI 2000
+#define CONFIG_CONTROL_PRESSURE_KD_MILLI 0
+#define CONFIG_CONTROL_REPORT_PERIOD 60
+#define CONFIG_SERVO_PWM_FREQUENCY 50
+#define CONFIG_SERVO_MIN_PULSE_US 500
+#define CONFIG_SERVO_MAX_PULSE_US 2500
+#define CONFIG_SERVO_MAX_ANGLE 180
+#define CONFIG_SENSORS_ACQUISITION 1
+#define CONFIG_SENSORS_ADC_DMA 1
+#define CONFIG_SENSORS_DMA_SAMPLE_RATE_HZ 80000
+#define CONFIG_SENSORS_DMA_CONVERSIONS 3
+#define CONFIG_SENSORS_DMA_DISCARD 1
+#define CONFIG_SENSORS_CORE 1
+#define CONFIG_SENSORS_POTENTIOMETER_RANGE_DEG 270
+#define CONFIG_SENSORS_REPORT_PERIOD 60
+#define CONFIG_HAND_MUX0_EN 4
+#define CONFIG_HAND_MUX0_S0 5
+#define CONFIG_HAND_MUX0_S1 6
+#define CONFIG_HAND_MUX0_S2 7
+#define CONFIG_HAND_MUX0_S3 15
+#define CONFIG_HAND_MUX0_SIG 1
+#define CONFIG_HAND_MUX1_EN 16
+#define CONFIG_HAND_MUX1_S0 17
+#define CONFIG_HAND_MUX1_S1 18
+#define CONFIG_HAND_MUX1_S2 8
+#define CONFIG_HAND_MUX1_S3 9
+#define CONFIG_HAND_MUX1_SIG 2
+#define CONFIG_HAND_SERVO0_PWM 38
+#define CONFIG_HAND_SERVO1_PWM 39
+#define CONFIG_HAND_SERVO2_PWM 40
+#define CONFIG_HAND_SERVO3_PWM 41
+#define CONFIG_HAND_SERVO4_PWM 42
+#define CONFIG_HAND_SERVO5_PWM 21
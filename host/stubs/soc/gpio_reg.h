@@ -0,0 +1,12 @@
+#pragma once
+
+#include "soc/soc.h"
+
+// GPIO output registers of the ESP32-S3, pins 0-31 and 32-48
+#define DR_REG_GPIO_BASE 0x60004000
+#define GPIO_OUT_REG (DR_REG_GPIO_BASE + 0x4)
+#define GPIO_OUT_W1TS_REG (DR_REG_GPIO_BASE + 0x8)
+#define GPIO_OUT_W1TC_REG (DR_REG_GPIO_BASE + 0xC)
+#define GPIO_OUT1_REG (DR_REG_GPIO_BASE + 0x10)
+#define GPIO_OUT1_W1TS_REG (DR_REG_GPIO_BASE + 0x14)
+#define GPIO_OUT1_W1TC_REG (DR_REG_GPIO_BASE + 0x18)
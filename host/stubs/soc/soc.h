@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Register access of the simulated board, GPIO output registers only
+// (host/sim/arduino_sim.cpp)
+void sim_reg_write(uint32_t reg, uint32_t value);
+uint32_t sim_reg_read(uint32_t reg);
+
+#define REG_WRITE(_r, _v) sim_reg_write((_r), (_v))
+#define REG_READ(_r) sim_reg_read((_r))
@@ -23,6 +23,7 @@
 #define DISABLED 0
 #define ENABLED 1
 #include <cstdint>
+#include "gpio_out.hpp"
 
 /**
  * @brief Interfaces the 74HC4067 multiplexers/demultiplexers.
@@ -44,6 +45,11 @@ class MUX74HC4067 {
   /**
    * @brief Selects the given channel, and enables its connection with the SIG
    * pin by default
+   * @details With every pin on GPIO 0-31 it is GPIO_OUT_W1TS and
+   * GPIO_OUT_W1TC writes with masks computed by the constructor: EN high,
+   * the select lines set and cleared, EN low, each a write of its own, so
+   * the connection is off while the select lines change. Otherwise one
+   * digitalWrite per pin.
    *
    * @param pin the channel to select
    * @param set flag (DISABLED or ENABLED) to indicate whether to leave the
@@ -121,4 +127,8 @@ class MUX74HC4067 {
   int8_t signal_pin_;
   int8_t control_pin_[4];
   uint8_t current_channel_;
+  bool register_write_;        // every pin on GPIO_OUT_REG
+  uint32_t enable_mask_;
+  uint32_t select_mask_;       // every control pin
+  uint32_t channel_mask_[16];  // control pins high for a channel
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "hand_topology.hpp"
+#include "sdkconfig.h"
+
+/*
+---------------------------------------------------
+sensor acquisition
+---------------------------------------------------
+
+sweeps every multiplexer channel that has a sensor (hand_topology.hpp),
+all multiplexers step together. switching a channel is one GPIO_OUT_W1TS
+and one GPIO_OUT_W1TC write with masks computed at compile time
+(gpio_out.hpp), the enable lines stay low and the previous channel is
+never restored. the multiplexer pins must be GPIO 0 to 31.
+
+SENSORS_ADC_DMA, the ADC paces the sweep: it converts the multiplexer
+outputs (ADC1) in continuous mode, SENSORS_DMA_CONVERSIONS of every
+output per DMA frame. the conversion done interrupt of a frame
+
+    drops the first SENSORS_DMA_DISCARD conversions of every output, they
+    convert while the mux settles and while the previous interrupt ran
+    averages the rest into the reading of the channel
+    selects the next channel, the ADC is already converting it
+
+the CPU only runs that interrupt, once per channel, no task wakes.
+
+otherwise a hardware timer alarms every SENSORS_SETTLE_US and wakes the
+acquisition task, which samples the channel selected by the previous step
+in oneshot mode (one conversion, it had a whole step to settle) and
+selects the next one.
+
+a sweep is done after the longest multiplexer schedule. its raw readings
+go to a ring, the control loop takes the newest sweep every tick for the
+pressure loops and HandState. samples per second, overruns and the step
+jitter are logged every SENSORS_REPORT_PERIOD s.
+*/
+
+class SensorAcquisition
+{
+public:
+    static constexpr size_t kPotentiometers = HandTopology::count(HandTopology::SensorKind::Potentiometer);
+    static constexpr size_t kStrainGauges = HandTopology::count(HandTopology::SensorKind::StrainGauge);
+
+    //raw ADC readings of one sweep, storage order of every kind
+    struct Sweep
+    {
+        int64_t timestamp_us; //first sample of the sweep
+        uint16_t potentiometers[kPotentiometers];
+        uint16_t straingauges[kStrainGauges];
+    };
+
+    struct Stats
+    {
+        uint32_t steps;         //channels, DMA frames with SENSORS_ADC_DMA
+        uint32_t sweeps;
+        uint32_t samples;       //readings stored, one per mux and channel
+        uint32_t discarded;     //settle conversions dropped, SENSORS_ADC_DMA
+        uint32_t overruns;      //alarms missed because a step ran late, frames skipped after a late switch
+        uint32_t dropped;       //sweeps overwritten before the control loop took them
+        uint32_t jitter_us_max; //step start against the timer or frame period
+        uint32_t settle_us_min; //shortest time from selecting a channel to sampling it
+        uint32_t step_us_max;
+        uint32_t busy_us;       //time in steps, wraps
+        uint32_t select_cycles;               //CPU cycles of a channel switch
+        uint32_t select_cycles_digital_write; //the same with digitalWrite per select line
+    };
+
+    /**
+     * @brief Multiplexer pins as outputs, every multiplexer enabled, ADC at 12 bits
+     *
+     * Logs the cycles of a channel switch, measured once
+     */
+    static void configure();
+
+    /**
+     * @brief Switch a multiplexer to a channel, at most two register writes
+     */
+    static void select(uint8_t mux, uint8_t channel);
+
+#ifdef CONFIG_SENSORS_ACQUISITION
+    /**
+     * @brief Configure the multiplexers, start the acquisition task and the
+     * ADC continuous conversions or the timer
+     */
+    static void init();
+
+    /**
+     * @brief Newest complete sweep, consumer side, older ones are discarded
+     *
+     * @param sweep Written only when there is a new sweep
+     * @return true - a sweep since the last call
+     */
+    static bool latest(Sweep &sweep);
+
+    /**
+     * @brief Counters since init, a copy taken after the last step of the acquisition task or interrupt
+     */
+    static Stats stats();
+
+    /**
+     * @brief Potentiometer angle of a raw reading, degrees, rounded
+     */
+    static constexpr int16_t degrees(uint16_t raw)
+    {
+        return (uint32_t(raw) * CONFIG_SENSORS_POTENTIOMETER_RANGE_DEG + kAdcFullScale / 2) / kAdcFullScale;
+    }
+
+private:
+    static constexpr uint32_t kAdcFullScale = (1 << 12) - 1;
+#endif
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "commands.pb.h"
+#include "hand_topology.hpp"
+
+/*
+---------------------------------------------------
+compact commands
+---------------------------------------------------
+
+protobuf commands are decoded once, at the MQTT boundary, into these
+trivially copyable structs. everything behind the boundary (commands queue,
+control loop) works with them only, so queueing a command is a memcpy
+of a few bytes instead of a heap-backed message copy.
+
+Command::ServoGoToAngle command = Command::decode(message);
+*/
+
+namespace Command
+{
+    //servo / finger index that does not fit the compact field
+    constexpr uint8_t kInvalidIndex = 0xFF;
+
+    //maximal number of angles carried by HoldGesture, one per servo
+    constexpr size_t kMaxGestureAngles = HandTopology::kServosCount;
+
+    struct ServoGoToAngle
+    {
+        uint8_t servo;
+        uint16_t angle;
+    };
+
+    struct ServoLock
+    {
+        uint8_t servo;
+    };
+
+    struct ServoUnLock
+    {
+        uint8_t servo;
+    };
+
+    struct ServoSmoothlyMove
+    {
+        uint8_t servo;
+        uint16_t angle;
+        uint32_t duration_ms;
+    };
+
+    struct MoveToTargetPressure
+    {
+        uint8_t finger;
+        uint32_t pressure;
+    };
+
+    struct HoldGesture
+    {
+        uint8_t gesture;
+        uint8_t angles_count;
+        uint16_t angles[kMaxGestureAngles];
+    };
+
+    ServoGoToAngle decode(const Commands::ServoGoToAngle &message);
+    ServoLock decode(const Commands::ServoLock &message);
+    ServoUnLock decode(const Commands::ServoUnLock &message);
+    ServoSmoothlyMove decode(const Commands::ServoSmoothlyMove &message);
+    MoveToTargetPressure decode(const Commands::MoveToTargetPressure &message);
+    HoldGesture decode(const Commands::HoldGesture &message);
+}
@@ -6,6 +6,14 @@
 #define MQTT_TOPIC_COMMANDS MQTT_TOPIC_ROOT_CONTROLLER "/commands"
 #define MQTT_TOPIC_NOTIFICATIONS MQTT_TOPIC_ROOT_CONTROLLER "/notifications"
 
+//every command topic, routed in the firmware
+#define MQTT_TOPIC_COMMANDS_ALL MQTT_TOPIC_COMMANDS "/#"
+
+//whole hand state in one message, see hand_frame.hpp
+#define MQTT_TOPIC_MONITORING_HAND_FRAME MQTT_TOPIC_MONITORING "/hand-frame"
+//hand frames recorded while offline, replayed after reconnecting
+#define MQTT_TOPIC_MONITORING_HAND_FRAME_REPLAY MQTT_TOPIC_MONITORING_HAND_FRAME "/replay"
+
 #define MQTT_TOPIC_MONITORING_IMU MQTT_TOPIC_MONITORING  "/imu"
 #define MQTT_TOPIC_MONITORING_STRAIN_GAUGE MQTT_TOPIC_MONITORING "/strain_gauge"
 #define MQTT_TOPIC_MONITORING_SERVO MQTT_TOPIC_MONITORING "/servo"
@@ -18,7 +26,7 @@
 
 #define MQTT_TOPIC_MONITORING_SERVO_INFO MQTT_TOPIC_MONITORING_SERVO "/info"
 
-#define MQTT_TOPIC_MONITORING_POTENTIOMETER_ANGLE_MEASUREMENT MQTT_TOPIC_MONITORING_POTENTIOMETER "angle-measurements"
+#define MQTT_TOPIC_MONITORING_POTENTIOMETER_ANGLE_MEASUREMENT MQTT_TOPIC_MONITORING_POTENTIOMETER "/angle-measurements"
 
 #define MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE MQTT_TOPIC_COMMANDS "/servo-go-to-angle"
 #define MQTT_TOPIC_COMMANDS_SERVO_LOCK MQTT_TOPIC_COMMANDS "/servo-lock"
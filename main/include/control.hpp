@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "sdkconfig.h"
+
+/*
+---------------------------------------------------
+control loop
+---------------------------------------------------
+
+executes the commands queue. a hardware timer ticks a task pinned to
+CONTROL_CORE at CONTROL_RATE_HZ, every tick:
+
+    drains CommandsQueue, a command superseded by a newer one of the same
+    drain is coalesced away (a slider sends many moves of one servo per
+    tick, only the last matters), commands older than
+    CONTROL_COMMAND_DEADLINE_MS are dropped, the others become a trajectory
+    of their servos
+    evaluates every trajectory at the tick time
+    writes changed setpoints to the servo PWM (LEDC) and to HandState,
+    with the newest sensor sweep (acquisition.hpp)
+
+trajectories are timed from the receipt of the command, a command that
+waited in the queue still finishes on time:
+
+    ServoGoToAngle        jump to the angle
+    ServoSmoothlyMove     S-curve to the angle, done duration_ms after receipt
+    HoldGesture           plays the gesture of the table (gestures.hpp), a command
+                          carrying angles moves those servos within
+                          CONTROL_GESTURE_DURATION_MS
+    MoveToTargetPressure  the finger servo closes until its strain gauge reads the
+                          pressure and keeps it, PI(D) loop in pressure.hpp
+    ServoLock             hold the current angle
+    ServoUnLock           stop the pulses, the servo goes limp until the next command
+
+moves are jerk-limited profiles (motion_profile.hpp) sampled when the
+command starts them, a tick only looks the angle up in fixed point.
+
+the time from a command reaching the MQTT task to its first PWM duty
+update is kept in a histogram and logged every CONTROL_REPORT_PERIOD s.
+*/
+
+class ControlLoop
+{
+public:
+    struct Stats
+    {
+        uint32_t ticks;
+        uint32_t overruns;  //ticks missed because the previous one ran late
+        uint32_t commands;  //executed
+        uint32_t coalesced; //superseded in the queue by a newer command, never executed
+        uint32_t expired;   //dropped, older than the deadline
+        uint32_t rejected;  //servo or finger out of range
+        uint32_t latency_us_mean; //receipt to the first PWM update
+        uint32_t latency_us_max;
+    };
+
+    /**
+     * @brief Attach the servos and start the control task and its timer
+     */
+    static void init();
+
+    /**
+     * @brief Counters since init, a copy may mix two ticks
+     */
+    static Stats stats();
+};
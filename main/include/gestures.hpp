@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "hand_topology.hpp"
+#include "motion_profile.hpp"
+#include "sdkconfig.h"
+
+/*
+---------------------------------------------------
+gestures
+---------------------------------------------------
+
+HoldGesture plays a named keyframe sequence from the gesture table, one
+compact position independent binary image, little endian:
+
+    Header              magic, version, servos per keyframe, entries, size,
+                        crc32 of everything after the header
+    Entry[count]        name, id, keyframes, mask of the servos moved,
+                        offset of the first keyframe
+    Keyframe[...]       time from the start of the gesture, angle of every
+                        servo in Q8 degrees
+
+GestureStore::load() copies the image of the gestures partition to RAM at
+boot, without a valid one the table built into the firmware (gestures.cpp)
+is used. the table is read only afterwards.
+
+GesturePlayer plays one entry: starting a gesture keeps the entry and the
+angles the servos start from, every tick eases from keyframe to keyframe
+in fixed point. switching gesture swaps the entry, nothing is planned per
+servo.
+*/
+
+namespace GestureTable
+{
+    constexpr uint32_t kMagic = 0x54534547; //"GEST"
+    constexpr uint16_t kVersion = 1;
+    constexpr size_t kNameSize = 12;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint8_t servos; //angles per keyframe, HandTopology::kServosCount
+        uint8_t count;  //entries
+        uint32_t size;  //whole image, bytes
+        uint32_t crc;   //crc32 of the image after the header
+    };
+
+    struct Entry
+    {
+        char name[kNameSize]; //zero padded
+        uint8_t id;           //HoldGesture.gesture
+        uint8_t keyframes;
+        uint16_t servos;      //mask of the servos the gesture moves
+        uint32_t offset;      //first keyframe, bytes from the start of the image
+    };
+
+    struct Keyframe
+    {
+        uint16_t time_ms; //from the start of the gesture, increasing
+        uint16_t angles[HandTopology::kServosCount];
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(Entry) == 20 &&
+                      sizeof(Keyframe) == 2 + 2 * HandTopology::kServosCount,
+                  "gesture table structs have padding");
+    static_assert(HandTopology::kServosCount <= 16, "servo mask is 16 bit");
+
+    /**
+     * @brief crc32 of an image, the header excluded
+     */
+    uint32_t crc(const uint8_t *image, size_t size);
+
+    /**
+     * @brief Check an image: header, crc, entries and keyframes in bounds,
+     * unique ids, increasing keyframe times, angles in range
+     */
+    bool valid(const uint8_t *image, size_t size);
+}
+
+class GestureStore
+{
+public:
+    /**
+     * @brief Load the table from a partition, the built-in one stays on failure
+     *
+     * @param label Partition label
+     * @return esp_err_t ESP_ERR_NOT_FOUND no partition, ESP_ERR_INVALID_SIZE
+     *                   larger than GESTURES_MAX_TABLE_SIZE,
+     *                   ESP_ERR_INVALID_STATE no valid image
+     */
+    static esp_err_t load(const char *label);
+
+    /**
+     * @brief Gesture by HoldGesture id
+     *
+     * @return const GestureTable::Entry* nullptr if the table has none
+     */
+    static const GestureTable::Entry *find(uint8_t id);
+
+    static const GestureTable::Keyframe *keyframes(const GestureTable::Entry &entry);
+
+    static const GestureTable::Entry *entries();
+
+    static size_t count();
+
+    //bytes of the table in use
+    static size_t size();
+
+    static bool builtIn();
+};
+
+class GesturePlayer
+{
+public:
+    using Angle = MotionProfile::Angle;
+
+    /**
+     * @brief Start a gesture, the previous one stops
+     *
+     * @param entry Gesture
+     * @param keyframes Its keyframes, kept by pointer
+     * @param from Angles of all servos at the start, Q8
+     */
+    void start(const GestureTable::Entry *entry, const GestureTable::Keyframe *keyframes, const Angle *from);
+
+    /**
+     * @brief Pose of the gesture
+     *
+     * @param elapsed_us Time since the start
+     * @param pose Angles, only the servos of the gesture are written
+     * @return true - playing, false - past the last keyframe, pose is the last one
+     */
+    bool at(uint32_t elapsed_us, Angle *pose);
+
+    uint16_t servos() const
+    {
+        return entry ? entry->servos : 0;
+    }
+
+private:
+    const GestureTable::Entry *entry = nullptr;
+    const GestureTable::Keyframe *keyframes = nullptr;
+    uint8_t segment = 0; //next keyframe, ticks only move forward
+    Angle from[HandTopology::kServosCount] = {};
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+
+/**
+ * @brief Several output pins in at most two register writes
+ *
+ * GPIO_OUT_W1TS and GPIO_OUT_W1TC drive the pins of a mask high and low
+ * atomically, other pins keep their level. digitalWrite goes through the
+ * peripheral manager and gpio_set_level for every pin instead.
+ *
+ * Masks are computed once, when the pins are known (mux construction, or
+ * at compile time from hand_topology.hpp), a write is then two stores.
+ * Only pins 0 to 31 (GPIO_OUT_REG), configured as outputs beforehand.
+ * On the host the registers are simulated and can be observed
+ * (sim::gpio::setRegisterObserver).
+ */
+struct GpioOut
+{
+    static constexpr uint8_t kPins = 32;
+
+    uint32_t set;   //pins driven high, written first
+    uint32_t clear; //pins driven low, written second
+
+    static constexpr bool fits(uint8_t pin)
+    {
+        return pin < kPins;
+    }
+
+    static constexpr uint32_t mask(uint8_t pin)
+    {
+        return fits(pin) ? 1u << pin : 0;
+    }
+
+    /**
+     * @brief Drive the pins, a pin in both masks ends low after a high pulse
+     */
+    void write() const
+    {
+        if (set != 0)
+        {
+            REG_WRITE(GPIO_OUT_W1TS_REG, set);
+        }
+        if (clear != 0)
+        {
+            REG_WRITE(GPIO_OUT_W1TC_REG, clear);
+        }
+    }
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "internal_api.hpp"
+
+/*
+---------------------------------------------------
+hand frame
+---------------------------------------------------
+
+the whole hand state in one protobuf message, published once per telemetry
+period instead of one message per sensor. encoded directly from a
+HandSnapshot in protobuf wire format, decode it with:
+
+message HandFrame {
+    uint64 timestamp_us = 1;                      // time of the snapshot
+    uint32 sequence = 2;                          // frame counter
+    repeated float imu_accel = 3 [packed=true];   // x of every imu, then y, then z
+    repeated float imu_gyro = 4 [packed=true];    // same layout as imu_accel
+    repeated float processed_imu_orientation = 5 [packed=true]; // roll, pitch, yaw
+    repeated sint32 potentiometer_angle = 6 [packed=true];      // hand_topology.hpp order
+    repeated uint32 straingauge_pressure = 7 [packed=true];     // thumb to little finger
+    repeated sint32 servo_angle = 8 [packed=true];              // hand_topology.hpp order
+
+    bool keyframe = 9;
+    //delta frames only: channel of every value of the matching field above
+    repeated uint32 imu_accel_index = 10 [packed=true];
+    repeated uint32 imu_gyro_index = 11 [packed=true];
+    repeated uint32 processed_imu_orientation_index = 12 [packed=true];
+    repeated uint32 potentiometer_angle_index = 13 [packed=true];
+    repeated uint32 straingauge_pressure_index = 14 [packed=true];
+    repeated uint32 servo_angle_index = 15 [packed=true];
+
+    //multi-sample frames only
+    uint32 samples = 16;            // readings per channel, sample by sample
+    uint32 sample_period_us = 17;   // nominal time between samples
+}
+
+a keyframe carries every channel and no index fields. a delta frame carries
+only the channels that moved beyond their deadband since they were last
+sent, value i belongs to channel index[i]; apply it on top of the last
+state. subscribers joining late wait for the next keyframe.
+
+a multi-sample frame (high-rate mode) is a keyframe of several samples:
+every value field holds all channels of the first sample, then all channels
+of the second and so on. timestamp_us is the time of the first sample.
+*/
+
+namespace HandFrame
+{
+    enum Field : uint32_t
+    {
+        TimestampUs = 1,
+        Sequence = 2,
+        ImuAccel = 3,
+        ImuGyro = 4,
+        ProcessedImuOrientation = 5,
+        PotentiometerAngle = 6,
+        StrainGaugePressure = 7,
+        ServoAngle = 8,
+        Keyframe = 9,
+        Samples = 16,
+        SamplePeriodUs = 17,
+        //index field of a value field
+        IndexOffset = 7,
+    };
+
+    //upper bound of an encoded frame of samples, a keyframe or a delta frame
+    constexpr size_t maxSize(size_t samples)
+    {
+        return (1 + 10) + (1 + 5) + (1 + 1) + (2 + 5) + (2 + 5) +
+               (2 * (1 + 3) + (4 * samples + 1) * HandLayout::kAxes * HandLayout::kImus) * 2 +
+               (2 * (1 + 3) + (4 * samples + 1) * HandLayout::kAxes * HandLayout::kProcessedImus) +
+               (2 * (1 + 3) + (3 * samples + 1) * HandLayout::kPotentiometers) +
+               (2 * (1 + 3) + (3 * samples + 1) * HandLayout::kStrainGauges) +
+               (2 * (1 + 3) + (3 * samples + 1) * HandLayout::kServos);
+    }
+
+    constexpr size_t kMaxSize = maxSize(1);
+
+    /**
+     * @brief Encode a snapshot as a keyframe
+     *
+     * @param snapshot Hand state
+     * @param sequence Frame counter
+     * @param buffer Output buffer
+     * @param size Output buffer size
+     * @return size_t Encoded size, 0 if the buffer is too small
+     */
+    size_t encode(const HandSnapshot &snapshot, uint32_t sequence, uint8_t *buffer, size_t size);
+
+    /**
+     * @brief Encode several samples as one multi-sample keyframe
+     *
+     * @param samples Snapshots in sampling order, timestamp_us of the first one is used
+     * @param count Number of samples
+     * @param sample_period_us Nominal time between samples
+     * @param sequence Frame counter
+     * @param buffer Output buffer, at least maxSize(count)
+     * @param size Output buffer size
+     * @return size_t Encoded size, 0 if the buffer is too small
+     */
+    size_t encodeSamples(const HandSnapshot *samples, size_t count, uint32_t sample_period_us,
+                         uint32_t sequence, uint8_t *buffer, size_t size);
+
+    //smallest change of a channel that is sent in a delta frame
+    struct Deadband
+    {
+        float imu;
+        uint16_t potentiometer;
+        uint16_t straingauge;
+        uint16_t servo;
+    };
+
+    /**
+     * @brief Encodes snapshots as delta frames against the values last sent
+     *
+     * encode() prepares a frame, commit() tells whether it was handed over to
+     * the client; only then the sent values become the new baseline. A frame
+     * that was not accepted forces a keyframe. The baseline is what was
+     * queued, not what the broker acknowledged: the caller requests a
+     * keyframe when a queued frame may have been lost.
+     */
+    class DeltaEncoder
+    {
+        Deadband deadband;
+        uint32_t keyframe_interval;
+        uint32_t sequence = 0;
+        uint32_t since_keyframe = 0;
+        bool keyframe_needed = true;
+        HandSnapshot baseline = {};
+        HandSnapshot pending = {};
+        bool pending_keyframe = false;
+
+    public:
+        /**
+         * @param deadband per channel kind
+         * @param keyframe_interval every n-th frame is a keyframe, 0 - only when needed
+         */
+        DeltaEncoder(Deadband deadband, uint32_t keyframe_interval)
+            : deadband(deadband), keyframe_interval(keyframe_interval) {}
+
+        /**
+         * @brief Encode the next frame
+         *
+         * @return size_t Encoded size, 0 if nothing changed or the buffer is too small
+         */
+        size_t encode(const HandSnapshot &snapshot, uint8_t *buffer, size_t size);
+
+        /**
+         * @brief Report the outcome of the last encoded frame
+         *
+         * @param accepted true if the frame was enqueued for sending
+         */
+        void commit(bool accepted);
+
+        //send a keyframe next, e.g. after reconnecting
+        void requestKeyframe()
+        {
+            keyframe_needed = true;
+        }
+
+        bool lastWasKeyframe() const
+        {
+            return pending_keyframe;
+        }
+    };
+}
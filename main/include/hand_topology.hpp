@@ -0,0 +1,289 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include "sdkconfig.h"
+
+/*
+---------------------------------------------------
+hand topology
+---------------------------------------------------
+
+constexpr description of the hand: fingers, joints, which multiplexer
+channel every analog sensor sits on and which pins drive the servos.
+the pins come from the "Hand wiring" menu, their defaults are placeholders
+that must be set to the board. storage sizes (HandLayout), the acquisition schedule and the telemetry
+order are derived from these tables at compile time, so changing the hand
+means editing this file only. mistakes (two sensors on one channel, a
+channel out of range, unsorted sensors) fail the build.
+*/
+
+namespace HandTopology
+{
+    constexpr size_t kFingers = 5;
+    constexpr size_t kMuxChannels = 16;
+
+    enum Finger : uint8_t
+    {
+        Thumb = 0,
+        Index = 1,
+        Middle = 2,
+        Ring = 3,
+        Little = 4,
+    };
+
+    enum class SensorKind : uint8_t
+    {
+        Potentiometer,
+        StrainGauge,
+    };
+
+    //74HC4067 multiplexer, sig is the ADC1 pin the common output connects to
+    struct Mux
+    {
+        uint8_t en;
+        uint8_t s0;
+        uint8_t s1;
+        uint8_t s2;
+        uint8_t s3;
+        uint8_t sig;
+    };
+
+    //analog sensor behind a multiplexer
+    struct Sensor
+    {
+        SensorKind kind;
+        uint8_t finger;
+        uint8_t joint; //potentiometer position, 0 - closest to the palm
+        uint8_t mux;
+        uint8_t channel;
+    };
+
+    struct Servo
+    {
+        uint8_t finger;
+        uint8_t pwm_pin;
+    };
+
+    //one mux channel to sample and where its value is stored
+    struct AcquisitionSlot
+    {
+        uint8_t channel;
+        SensorKind kind;
+        uint8_t slot; //index in the storage of this kind
+    };
+
+    constexpr Mux kMuxes[] = {
+        {.en = CONFIG_HAND_MUX0_EN, .s0 = CONFIG_HAND_MUX0_S0, .s1 = CONFIG_HAND_MUX0_S1,
+         .s2 = CONFIG_HAND_MUX0_S2, .s3 = CONFIG_HAND_MUX0_S3, .sig = CONFIG_HAND_MUX0_SIG},
+        {.en = CONFIG_HAND_MUX1_EN, .s0 = CONFIG_HAND_MUX1_S0, .s1 = CONFIG_HAND_MUX1_S1,
+         .s2 = CONFIG_HAND_MUX1_S2, .s3 = CONFIG_HAND_MUX1_S3, .sig = CONFIG_HAND_MUX1_SIG},
+    };
+
+    //sensors of one kind are listed finger by finger, joint by joint,
+    //their order is the storage and telemetry order
+    constexpr Sensor kSensors[] = {
+        {SensorKind::Potentiometer, Thumb, 0, 0, 0},
+        {SensorKind::Potentiometer, Thumb, 1, 0, 1},
+        {SensorKind::Potentiometer, Thumb, 2, 0, 2},
+        {SensorKind::Potentiometer, Thumb, 3, 0, 3},
+        {SensorKind::Potentiometer, Thumb, 4, 0, 4},
+        {SensorKind::Potentiometer, Index, 0, 0, 5},
+        {SensorKind::Potentiometer, Index, 1, 0, 6},
+        {SensorKind::Potentiometer, Index, 2, 0, 7},
+        {SensorKind::Potentiometer, Index, 3, 0, 8},
+        {SensorKind::Potentiometer, Middle, 0, 0, 9},
+        {SensorKind::Potentiometer, Middle, 1, 0, 10},
+        {SensorKind::Potentiometer, Middle, 2, 0, 11},
+        {SensorKind::Potentiometer, Middle, 3, 0, 12},
+        {SensorKind::Potentiometer, Ring, 0, 0, 13},
+        {SensorKind::Potentiometer, Ring, 1, 0, 14},
+        {SensorKind::Potentiometer, Ring, 2, 0, 15},
+        {SensorKind::Potentiometer, Ring, 3, 1, 0},
+        {SensorKind::Potentiometer, Little, 0, 1, 1},
+        {SensorKind::Potentiometer, Little, 1, 1, 2},
+        {SensorKind::Potentiometer, Little, 2, 1, 3},
+        {SensorKind::Potentiometer, Little, 3, 1, 4},
+        {SensorKind::StrainGauge, Thumb, 0, 1, 8},
+        {SensorKind::StrainGauge, Index, 0, 1, 9},
+        {SensorKind::StrainGauge, Middle, 0, 1, 10},
+        {SensorKind::StrainGauge, Ring, 0, 1, 11},
+        {SensorKind::StrainGauge, Little, 0, 1, 12},
+    };
+
+    //the last servo rotates the thumb
+    constexpr Servo kServos[] = {
+        {Thumb, CONFIG_HAND_SERVO0_PWM},
+        {Index, CONFIG_HAND_SERVO1_PWM},
+        {Middle, CONFIG_HAND_SERVO2_PWM},
+        {Ring, CONFIG_HAND_SERVO3_PWM},
+        {Little, CONFIG_HAND_SERVO4_PWM},
+        {Thumb, CONFIG_HAND_SERVO5_PWM},
+    };
+
+    //IMUs sit on I2C, the processed IMU is computed from them
+    constexpr size_t kImus = 3;
+    constexpr size_t kProcessedImus = 1;
+
+    constexpr size_t kMuxesCount = std::size(kMuxes);
+    constexpr size_t kSensorsCount = std::size(kSensors);
+    constexpr size_t kServosCount = std::size(kServos);
+
+    constexpr size_t count(SensorKind kind)
+    {
+        size_t result = 0;
+        for (auto &sensor : kSensors)
+        {
+            result += sensor.kind == kind;
+        }
+        return result;
+    }
+
+    constexpr size_t countOnFinger(SensorKind kind, size_t finger)
+    {
+        size_t result = 0;
+        for (auto &sensor : kSensors)
+        {
+            result += sensor.kind == kind && sensor.finger == finger;
+        }
+        return result;
+    }
+
+    //storage index of the first sensor of kind on finger
+    constexpr size_t first(SensorKind kind, size_t finger)
+    {
+        size_t result = 0;
+        for (size_t i = 0; i < finger; i++)
+        {
+            result += countOnFinger(kind, i);
+        }
+        return result;
+    }
+
+    //servo that closes a finger, the first one on it, kServosCount if the finger has none
+    constexpr size_t fingerServo(size_t finger)
+    {
+        for (size_t i = 0; i < kServosCount; i++)
+        {
+            if (kServos[i].finger == finger)
+            {
+                return i;
+            }
+        }
+        return kServosCount;
+    }
+
+    //sensor stored at slot in the storage of kind
+    constexpr const Sensor &sensor(SensorKind kind, size_t slot)
+    {
+        for (auto &sensor : kSensors)
+        {
+            if (sensor.kind == kind && slot-- == 0)
+            {
+                return sensor;
+            }
+        }
+        return kSensors[0];
+    }
+
+    constexpr size_t channelsOn(size_t mux)
+    {
+        size_t result = 0;
+        for (auto &sensor : kSensors)
+        {
+            result += sensor.mux == mux;
+        }
+        return result;
+    }
+
+    //channels of one mux in sweep order
+    template <size_t MuxIdx>
+    constexpr auto acquisitionSchedule()
+    {
+        std::array<AcquisitionSlot, channelsOn(MuxIdx)> schedule = {};
+        size_t n = 0;
+        for (uint8_t channel = 0; channel < kMuxChannels; channel++)
+        {
+            size_t slots[2] = {0, 0};
+            for (auto &sensor : kSensors)
+            {
+                size_t &slot = slots[static_cast<size_t>(sensor.kind)];
+                if (sensor.mux == MuxIdx && sensor.channel == channel)
+                {
+                    schedule[n++] = {channel, sensor.kind, static_cast<uint8_t>(slot)};
+                }
+                slot++;
+            }
+        }
+        return schedule;
+    }
+
+    constexpr bool valid()
+    {
+        for (size_t i = 0; i < kSensorsCount; i++)
+        {
+            auto &a = kSensors[i];
+            if (a.mux >= kMuxesCount || a.channel >= kMuxChannels || a.finger >= kFingers)
+            {
+                return false;
+            }
+            for (size_t j = i + 1; j < kSensorsCount; j++)
+            {
+                auto &b = kSensors[j];
+                if (a.mux == b.mux && a.channel == b.channel)
+                {
+                    return false;
+                }
+                //storage is finger by finger, joint by joint
+                if (a.kind == b.kind &&
+                    (b.finger < a.finger || (b.finger == a.finger && b.joint <= a.joint)))
+                {
+                    return false;
+                }
+            }
+        }
+        for (auto &servo : kServos)
+        {
+            if (servo.finger >= kFingers)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //every multiplexer and servo pin is a GPIO of its own
+    constexpr bool pinsDistinct()
+    {
+        uint8_t pins[kMuxesCount * 6 + kServosCount] = {};
+        size_t n = 0;
+        for (auto &mux : kMuxes)
+        {
+            for (uint8_t pin : {mux.en, mux.s0, mux.s1, mux.s2, mux.s3, mux.sig})
+            {
+                pins[n++] = pin;
+            }
+        }
+        for (auto &servo : kServos)
+        {
+            pins[n++] = servo.pwm_pin;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            for (size_t j = i + 1; j < n; j++)
+            {
+                if (pins[i] == pins[j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static_assert(valid(), "hand topology: sensor on an invalid or shared channel, or sensors unsorted");
+    static_assert(pinsDistinct(), "hand wiring: a GPIO is used by two multiplexer or servo pins");
+    static_assert(count(SensorKind::StrainGauge) == kFingers, "one strain gauge per finger");
+}
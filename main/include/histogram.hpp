@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "esp_log.h"
+
+/**
+ * @brief Fixed-bucket histogram of durations, no allocation
+ *
+ * Values from 0 up to Buckets * BucketWidth are counted in equal buckets,
+ * larger values go to the last one. Single writer, not thread safe.
+ *
+ * @tparam Buckets number of buckets
+ * @tparam BucketWidth width of a bucket, in the unit of the recorded values
+ */
+template <size_t Buckets, uint32_t BucketWidth>
+class Histogram
+{
+    uint32_t buckets[Buckets] = {};
+    uint32_t samples = 0;
+    uint32_t min_value = UINT32_MAX;
+    uint32_t max_value = 0;
+    uint64_t sum = 0;
+
+public:
+    void record(uint32_t value)
+    {
+        size_t idx = value / BucketWidth;
+        buckets[idx < Buckets ? idx : Buckets - 1]++;
+        samples++;
+        sum += value;
+        min_value = value < min_value ? value : min_value;
+        max_value = value > max_value ? value : max_value;
+    }
+
+    void reset()
+    {
+        *this = Histogram();
+    }
+
+    uint32_t count() const
+    {
+        return samples;
+    }
+
+    uint32_t min() const
+    {
+        return samples ? min_value : 0;
+    }
+
+    uint32_t max() const
+    {
+        return max_value;
+    }
+
+    uint32_t mean() const
+    {
+        return samples ? sum / samples : 0;
+    }
+
+    //smallest bucket bound below which at least permille of the values lie
+    uint32_t percentile(uint32_t permille) const
+    {
+        uint64_t target = (uint64_t(samples) * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < Buckets; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+            {
+                return (i + 1) * BucketWidth;
+            }
+        }
+        return Buckets * BucketWidth;
+    }
+
+    /**
+     * @brief Log summary and non-empty buckets
+     *
+     * @param tag log tag
+     * @param name histogram name
+     */
+    void log(const char *tag, const char *name) const
+    {
+        ESP_LOGI(tag, "%s: n=%lu min=%lu mean=%lu p99<%lu max=%lu", name,
+                 (unsigned long)samples, (unsigned long)min(), (unsigned long)mean(),
+                 (unsigned long)percentile(990), (unsigned long)max_value);
+        char line[256];
+        int len = 0;
+        for (size_t i = 0; i < Buckets && len < int(sizeof(line)) - 24; i++)
+        {
+            if (buckets[i])
+            {
+                len += snprintf(line + len, sizeof(line) - len, " [%lu]=%lu",
+                                (unsigned long)(i * BucketWidth), (unsigned long)buckets[i]);
+            }
+        }
+        if (len)
+        {
+            ESP_LOGI(tag, "%s:%s", name, line);
+        }
+    }
+};
@@ -1,14 +1,21 @@
 #pragma once
 
 #include "small_mutex.hpp"
-#include <queue>
-#include "commands.pb.h"
+#include "snapshot_buffer.hpp"
+#include "spsc_ring.hpp"
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "command_types.hpp"
+#include "hand_topology.hpp"
 #include "imu.pb.h"
 #include "potentiometer.pb.h"
 #include "servo.pb.h"
 #include "shared.pb.h"
 #include "straingauge.pb.h"
 #include "variant"
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
 
 /*
 ---------------------------------------------------
@@ -54,89 +61,163 @@ std::string connectionpin = potentiometer.connectionpin();
 
 
 
-class HandState{
-    static SmallMutex mutex;
-    static std::vector<Imu::IMU> imus;
-    static std::vector<Imu::ResultIMU> processed_imus;
-    static std::vector<Potentiometer::Potentiometer> potentiometers;
-    static std::vector<Straingauge::StrainGuage> straingauges;
-    static std::vector<Servo::Servo> servos;
+//sizes of the hand state, derived from the topology (hand_topology.hpp)
+namespace HandLayout{
+    constexpr size_t kFingers = HandTopology::kFingers;
+    constexpr size_t kAxes = 3;
 
-public: 
+    constexpr size_t kImus = HandTopology::kImus;
+    constexpr size_t kProcessedImus = HandTopology::kProcessedImus;
+    constexpr size_t kPotentiometers = HandTopology::count(HandTopology::SensorKind::Potentiometer);
+    constexpr size_t kStrainGauges = HandTopology::count(HandTopology::SensorKind::StrainGauge);
+    constexpr size_t kServos = HandTopology::kServosCount;
+
+    //potentiometers are stored finger by finger, thumb first
+    constexpr size_t firstPotentiometer(size_t finger){
+        return HandTopology::first(HandTopology::SensorKind::Potentiometer, finger);
+    }
+
+    enum Axis : uint8_t { X = 0, Y = 1, Z = 2 };
+    enum Orientation : uint8_t { Roll = 0, Pitch = 1, Yaw = 2 };
+}
+
+/*
+one complete, consistent state of the hand. 
+
+structure of arrays, one contiguous array per channel, so the control loop 
+reads e.g. all potentiometer angles from one cache line instead of walking 
+protobuf messages. protobuf messages are built only at the telemetry edge 
+(see toMessage and HandState::getState)
+*/
+struct HandSnapshot{
+    int64_t timestamp_us; //time of the last write, esp_timer_get_time
+
+    //Imu::IMU
+    float imu_accel[HandLayout::kAxes][HandLayout::kImus];
+    float imu_gyro[HandLayout::kAxes][HandLayout::kImus];
+    //Imu::ResultIMU
+    float processed_imu_orientation[HandLayout::kAxes][HandLayout::kProcessedImus];
+    //Potentiometer::Potentiometer
+    int16_t potentiometer_angle[HandLayout::kPotentiometers];
+    //Straingauge::StrainGuage
+    uint16_t straingauge_pressure[HandLayout::kStrainGauges];
+    //Servo::Servo
+    int16_t servo_angle[HandLayout::kServos];
+
+    //number of sensors of the protobuf type T
     template<typename T>
-    static T & getState(int idx){
+    static constexpr size_t count(){
         if constexpr(std::is_same_v<T, Imu::IMU>){
-            return imus[idx];
+            return HandLayout::kImus;
         }
         else if constexpr(std::is_same_v<T, Imu::ResultIMU>){
-            return processed_imus[idx];
+            return HandLayout::kProcessedImus;
         }
         else if constexpr(std::is_same_v<T, Potentiometer::Potentiometer>){
-            return potentiometers[idx];
+            return HandLayout::kPotentiometers;
         }
         else if constexpr(std::is_same_v<T, Straingauge::StrainGuage>){
-            return straingauges[idx];
+            return HandLayout::kStrainGauges;
         }
         else if constexpr(std::is_same_v<T, Servo::Servo>){
-            return servos[idx];
+            return HandLayout::kServos;
         }
     }
+};
+
+static_assert(std::is_trivially_copyable_v<HandSnapshot>);
+
+//telemetry edge: build protobuf messages from a snapshot and back
+void toMessage(const HandSnapshot &snapshot, int idx, Imu::IMU &message);
+void toMessage(const HandSnapshot &snapshot, int idx, Imu::ResultIMU &message);
+void toMessage(const HandSnapshot &snapshot, int idx, Potentiometer::Potentiometer &message);
+void toMessage(const HandSnapshot &snapshot, int idx, Straingauge::StrainGuage &message);
+void toMessage(const HandSnapshot &snapshot, int idx, Servo::Servo &message);
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Imu::IMU &message);
+void fromMessage(HandSnapshot &snapshot, int idx, const Imu::ResultIMU &message);
+void fromMessage(HandSnapshot &snapshot, int idx, const Potentiometer::Potentiometer &message);
+void fromMessage(HandSnapshot &snapshot, int idx, const Straingauge::StrainGuage &message);
+void fromMessage(HandSnapshot &snapshot, int idx, const Servo::Servo &message);
+
+/*
+readers (telemetry, control loop) pin a published snapshot and never block 
+writers, writers (sensor tasks) publish complete snapshots:
+
+{
+    auto snapshot = HandState::snapshot();
+    int16_t angle = snapshot->potentiometer_angle[HandLayout::firstPotentiometer(1)];
+} //snapshot released here
 
+HandState::update([](HandSnapshot &state){
+    state.potentiometer_angle[0] = 45;
+    state.potentiometer_angle[1] = 50;
+});
+*/
+class HandState{
+public: 
+    //telemetry, control loop and one spare
+    static constexpr size_t kMaxReaders = 3;
+
+private: 
+    static SnapshotBuffer<HandSnapshot, kMaxReaders> state;
+
+public: 
+    using Snapshot = SnapshotBuffer<HandSnapshot, kMaxReaders>::ReadGuard;
+
+    //keep the snapshot only as long as needed, it holds one of the buffers
+    static Snapshot snapshot(){
+        return state.read();
+    }
+
+    //compatibility adaptor, builds the protobuf message of one sensor
     template<typename T>
-    static int getStateExemplarsCount(){
-        if constexpr(std::is_same_v<T, Imu::IMU>){
-            return imus.size();
-        }
-        else if constexpr(std::is_same_v<T, Imu::ResultIMU>){
-            return processed_imus.size();
-        }
-        else if constexpr(std::is_same_v<T, Potentiometer::Potentiometer>){
-            return potentiometers.size();
-        }
-        else if constexpr(std::is_same_v<T, Straingauge::StrainGuage>){
-            return straingauges.size();
-        }
-        else if constexpr(std::is_same_v<T, Servo::Servo>){
-            return servos.size();
-        }
+    static T getState(int idx){
+        configASSERT(idx >= 0 && size_t(idx) < HandSnapshot::count<T>());
+        T message;
+        toMessage(*snapshot(), idx, message);
+        return message;
     }
 
-    static void lock(){
-        mutex.lock();
+    //compile-time checked index
+    template<typename T, size_t Idx>
+    static T getState(){
+        static_assert(Idx < HandSnapshot::count<T>(), "sensor index out of range");
+        return getState<T>(Idx);
     }
-    static void unlock(){
-        mutex.unlock();
+
+    template<typename T>
+    static constexpr int getStateExemplarsCount(){
+        return HandSnapshot::count<T>();
     }
-    static void init(int imus_count, int processed_imus_count, 
-        int potentiometers_count, int straingauges_count, int servos_count){
-        lock();
-        imus.clear();
-        processed_imus.clear();
-        potentiometers.clear();
-        straingauges.clear();
-        servos.clear();
-        for (int i = 0; i < imus_count; i++){
-            Imu::IMU temp;
-            imus.push_back(temp);
-        }
-        for (int i = 0; i < processed_imus_count; i++){
-            Imu::ResultIMU temp;
-            processed_imus.push_back(temp);
-        }
-        for (int i = 0; i < potentiometers_count; i++){
-            Potentiometer::Potentiometer temp;
-            potentiometers.push_back(temp);
-        }
-        for (int i = 0; i < straingauges_count; i++){
-            Straingauge::StrainGuage temp;
-            straingauges.push_back(temp);
-        }
-        for (int i = 0; i < servos_count; i++){
-            Servo::Servo temp;
-            servos.push_back(temp);
-        }
-        //todo
-        unlock();
+
+    template<typename T>
+    static void setState(int idx, const T &value){
+        configASSERT(idx >= 0 && size_t(idx) < HandSnapshot::count<T>());
+        state.write([&](HandSnapshot &snapshot){
+            fromMessage(snapshot, idx, value);
+            snapshot.timestamp_us = esp_timer_get_time();
+        });
+    }
+
+    template<typename T, size_t Idx>
+    static void setState(const T &value){
+        static_assert(Idx < HandSnapshot::count<T>(), "sensor index out of range");
+        setState<T>(Idx, value);
+    }
+
+    //apply several changes as one snapshot
+    template<typename F>
+    static void update(F &&mutate){
+        state.write([&](HandSnapshot &snapshot){
+            mutate(snapshot);
+            snapshot.timestamp_us = esp_timer_get_time();
+        });
+    }
+
+    //number of published snapshots
+    static uint32_t version(){
+        return state.version();
     }
 };
 
@@ -145,13 +226,23 @@ public:
 namespace CommandsQueue{
     //using namespace Commands;
 
+    //compact trivially copyable commands, see command_types.hpp
     using CommandType = std::variant
-        <Commands::ServoGoToAngle, Commands::ServoLock, Commands::ServoUnLock, 
-        Commands::ServoSmoothlyMove, Commands::MoveToTargetPressure, Commands::HoldGesture>;
+        <Command::ServoGoToAngle, Command::ServoLock, Command::ServoUnLock, 
+        Command::ServoSmoothlyMove, Command::MoveToTargetPressure, Command::HoldGesture>;
+
+    static_assert(std::is_trivially_copyable_v<CommandType>, 
+        "commands are queued by memcpy");
+
+    //a command and when the MQTT task received it, for deadlines and latency
+    struct QueuedCommand{
+        CommandType command;
+        int64_t received_us; //esp_timer_get_time
+    };
 
     //its a helpers
     template <typename T>
-    bool commandIs(CommandType command){
+    bool commandIs(const CommandType &command){
         return std::holds_alternative<T>(command);
     }
 
@@ -160,7 +251,7 @@ namespace CommandsQueue{
     /*
     try 
     {
-        ServoGoToAngle f = std::get<ServoGoToAngle>(command); 
+        Command::ServoGoToAngle f = std::get<Command::ServoGoToAngle>(command); 
         //do some work
     }
     catch (std::bad_variant_access&) 
@@ -168,53 +259,103 @@ namespace CommandsQueue{
         std::cout << "our variant doesn't hold ServoGoToAngle at this moment...\n";
     }*/
     template <typename T> 
-    auto getIf(CommandType command){
-        return *(std::get_if<T>(command));
+    auto getIf(const CommandType &command){
+        return *(std::get_if<T>(&command));
     }
     
 
     //its a magic
+    //single producer (mqtt event task) / single consumer (control loop)
     struct Queue{
     private:
-        static std::queue<CommandType> queue;
+        static SpscRing<QueuedCommand, CONFIG_COMMANDS_QUEUE_CAPACITY, 
+            OverflowPolicy::DropNewest> queue;
     public: 
+        using Stats = decltype(queue)::Stats;
+
         static auto size(){
             return queue.size();
         }
 
-        static void push(CommandType command){
-            queue.push(command);
+        //returns false if the queue is full and the command was dropped
+        static bool push(const CommandType &command){
+            return queue.push({command, esp_timer_get_time()});
         }
 
         template<typename T>
-        static void push(T command){
+        static bool push(const T &command){
             CommandType command_ = command;
-            queue.push(command_);
+            return push(command_);
+        }
+
+        //returns false if the queue is empty
+        static bool pop(QueuedCommand &command){
+            return queue.pop(command);
+        }
+
+        static bool pop(CommandType &command){
+            QueuedCommand queued;
+            if(!queue.pop(queued)){
+                return false;
+            }
+            command = queued.command;
+            return true;
         }
 
-        static CommandType pop(){
-            auto val = queue.front();
-            queue.pop();
-            return val;
+        static Stats stats(){
+            return queue.stats();
         }
+
+        //pops every pending command into batch, oldest first, and drops the
+        //ones a newer command in the batch makes pointless (COMMANDS_COALESCE):
+        //  GoToAngle, SmoothlyMove  <- a newer move of the servo or a gesture covering it
+        //  MoveToTargetPressure     <- a newer one on the finger or a move of its servo
+        //  HoldGesture              <- a newer gesture covering the same servos,
+        //                              its angles or its entry of the gesture table
+        //lock / unlock are always kept. returns the number of commands left
+        static size_t drain(QueuedCommand *batch, size_t capacity);
+
+        //commands drain dropped as superseded, consumer side counter
+        static uint32_t coalesced(){
+            return coalesced_;
+        }
+
+    private:
+        static std::atomic<uint32_t> coalesced_;
     };
 
     //its an api
-    static auto size(){
+    inline auto size(){
         return Queue::size();
     }
 
-    static void push(CommandType command){
+    inline bool push(const CommandType &command){
         return Queue::push(command);
     }
 
     template<typename T>
-    static void push(T command){
+    inline bool push(const T &command){
         CommandType command_ = command;
         return Queue::push(command_);
     }
 
-    static CommandType pop(){
-        return Queue::pop();
+    inline bool pop(CommandType &command){
+        return Queue::pop(command);
+    }
+
+    inline bool pop(QueuedCommand &command){
+        return Queue::pop(command);
+    }
+
+    inline Queue::Stats stats(){
+        return Queue::stats();
+    }
+
+    inline size_t drain(QueuedCommand *batch, size_t capacity){
+        return Queue::drain(batch, capacity);
+    }
+
+    inline uint32_t coalesced(){
+        return Queue::coalesced();
     }
 }
\ No newline at end of file
@@ -1,96 +1,269 @@
 #pragma once
 
 #include "internal_api.hpp"
+#include "hand_frame.hpp"
+#include "histogram.hpp"
+#include "spool.hpp"
+#include "Arduino.h"
+#include "esp_timer.h"
 #include "mqtt.hpp"
 #include "sdkconfig.h"
 #include "config.hpp"
+#include "utils.hpp"
 
 
 class MiddleWare{
+    static constexpr const char *TAG = "MIDDLEWARE";
+    static constexpr auto kTelemetry = MqttClient::policy(MqttClient::TopicClass::Telemetry);
+
+#ifdef CONFIG_MIDDLEWARE_DELTA_FRAMES
+    static inline HandFrame::DeltaEncoder encoder{
+        {
+            .imu = CONFIG_MIDDLEWARE_DEADBAND_IMU_MILLI / 1000.0f,
+            .potentiometer = CONFIG_MIDDLEWARE_DEADBAND_POTENTIOMETER,
+            .straingauge = CONFIG_MIDDLEWARE_DEADBAND_STRAIN_GAUGE,
+            .servo = CONFIG_MIDDLEWARE_DEADBAND_SERVO,
+        },
+        CONFIG_MIDDLEWARE_KEYFRAME_INTERVAL};
+#else
+    //every frame is a keyframe
+    static inline HandFrame::DeltaEncoder encoder{{}, 1};
+#endif
+    static inline uint8_t frame[HandFrame::kMaxSize];
+    static_assert(sizeof(frame) <= CONFIG_MQTT_TELEMETRY_SLOT_SIZE,
+        "a hand frame must fit a telemetry lane slot, raise MQTT_TELEMETRY_SLOT_SIZE");
+    //frames possibly lost after leaving the encoder, as last seen by it
+    static inline uint32_t frames_lost = 0;
+
+#ifdef CONFIG_MIDDLEWARE_SPOOL
+    static inline Spool spool;
+    static inline uint32_t spool_sequence = 0;
+
+    //offline: one self-contained keyframe per period goes to flash
+    static void spoolFrame(const HandSnapshot &snapshot){
+        size_t size = HandFrame::encode(snapshot, spool_sequence++, frame, sizeof(frame));
+        esp_err_t err = spool.append(frame, size);
+        if(err != ESP_OK){
+            ESP_LOGW(TAG, "frame not spooled: %s", esp_err_to_name(err));
+        }
+        //live frames resume with a keyframe
+        encoder.requestKeyframe();
+    }
+
+    //online: a few spooled frames per period, oldest first
+    static void replaySpool(){
+        for(int i = 0; i < CONFIG_MIDDLEWARE_SPOOL_REPLAY_PER_PERIOD; i++){
+            //never push live frames out of the telemetry lane
+            if(MqttClient::getInstance().telemetrySpace() <= 1){
+                return;
+            }
+            size_t size = spool.peek(frame, sizeof(frame));
+            if(size == 0){
+                return;
+            }
+            //keyframes of the past, a retained one would shadow the live state
+            if(!MqttClient::getInstance().sendTelemetry(
+                MQTT_TOPIC_MONITORING_HAND_FRAME_REPLAY,
+                frame,
+                size,
+                MqttClient::policy(MqttClient::TopicClass::StateSnapshot).qos,
+                0
+            )){
+                //stays in the spool, retried next period
+                return;
+            }
+            spool.pop();
+        }
+    }
+#endif
+
+    //whole hand state (or what changed of it), at most one publish per period
+    static void sendFrame(const HandSnapshot &snapshot){
+#ifdef CONFIG_MIDDLEWARE_SPOOL
+        if(spool.mounted() && !MqttClient::getInstance().isConnected()){
+            spoolFrame(snapshot);
+            return;
+        }
+#endif
+        //the baseline advances when a frame is queued: telemetry is QoS 0 over
+        //TCP, a queued frame reaches the broker unless the lane overwrites it,
+        //its publish fails or the connection breaks. all three are counted,
+        //each one starts over with a keyframe
+        auto &client = MqttClient::getInstance();
+        auto lane = client.getLaneStats(MqttClient::Lane::Telemetry);
+        uint32_t lost = lane.dropped + lane.failed + client.getReconnectStats().reconnects;
+        if(lost != frames_lost){
+            frames_lost = lost;
+            encoder.requestKeyframe();
+        }
+        size_t size = encoder.encode(snapshot, frame, sizeof(frame));
+        if(size == 0){
+            return;
+        }
+        auto policy = MqttClient::policy(encoder.lastWasKeyframe() ?
+            MqttClient::TopicClass::StateSnapshot : MqttClient::TopicClass::Telemetry);
+        bool queued = MqttClient::getInstance().sendTelemetry(
+            MQTT_TOPIC_MONITORING_HAND_FRAME,
+            frame,
+            size,
+            policy.qos,
+            policy.retain
+        );
+        encoder.commit(queued);
+    }
+
+#ifdef CONFIG_MIDDLEWARE_PER_SENSOR_TOPICS
+    //legacy telemetry, one publish per sensor
+    static inline uint8_t sensor_message[64];
+
+    template<typename T>
+    static void sendState(const HandSnapshot &snapshot, const char *topic){
+        T item;
+        for(int i = 0; i < HandState::getStateExemplarsCount<T>(); i++)
+        {
+            toMessage(snapshot, i, item);
+            size_t size = serializeToBuffer(item, sensor_message);
+            MqttClient::getInstance().sendTelemetry(
+                topic, 
+                sensor_message, 
+                size,
+                kTelemetry.qos,
+                kTelemetry.retain
+            );
+        }
+    }
+#endif
+
     static void sendingStateTask (void *pvParameters){
         for(;;){
-            for(int i = 0; i < 
-                HandState::getStateExemplarsCount<Imu::IMU>(); 
-                    i++)
             {
-                std::string message;
-                HandState::getState<Imu::IMU>(i).SerializeToString(&message);
-                MqttClient::getInstance().sendEnqueue(
-                    MQTT_TOPIC_MONITORING_IMU_RAW_DATA, 
-                    message.data(), 
-                    message.size(),
-                    CONFIG_MQTT_QOS_LEVEL,
-                    0,
-                    1
-                );
+                //every tick is sent from one consistent snapshot
+                auto snapshot = HandState::snapshot();
+                sendFrame(*snapshot);
+#ifdef CONFIG_MIDDLEWARE_SPOOL
+                if(MqttClient::getInstance().isConnected()){
+                    replaySpool();
+                }
+#endif
+#ifdef CONFIG_MIDDLEWARE_PER_SENSOR_TOPICS
+                sendState<Imu::IMU>(*snapshot, MQTT_TOPIC_MONITORING_IMU_RAW_DATA);
+                sendState<Imu::ResultIMU>(*snapshot, MQTT_TOPIC_MONITORING_IMU_PROCESSED_DATA);
+                sendState<Potentiometer::Potentiometer>(*snapshot, MQTT_TOPIC_MONITORING_POTENTIOMETER_ANGLE_MEASUREMENT);
+                sendState<Straingauge::StrainGuage>(*snapshot, MQTT_TOPIC_MONITORING_STRAIN_GAUGE_PRESSURE_AT_FINGERTIPS);
+                sendState<Servo::Servo>(*snapshot, MQTT_TOPIC_MONITORING_SERVO_INFO);
+#endif
             }
-            for(int i = 0; i < 
-                HandState::getStateExemplarsCount<Imu::ResultIMU>(); 
-                    i++)
-            {
-                std::string message;
-                HandState::getState<Imu::ResultIMU>(i).SerializeToString(&message);
-                MqttClient::getInstance().sendEnqueue(
-                    MQTT_TOPIC_MONITORING_IMU_RAW_DATA, 
-                    message.data(), 
-                    message.size(),
-                    CONFIG_MQTT_QOS_LEVEL,
-                    0,
-                    1
-                );
+            
+            vTaskDelay(pdMS_TO_TICKS
+                (CONFIG_MIDDLEWARE_SENDING_STATE_PERIOD));
+        }
+    }
+#ifdef CONFIG_MIDDLEWARE_HIGH_RATE
+    //to the microsecond, any rate: the period is not a whole number of ticks
+    static constexpr uint32_t kSamplePeriodUs = 1000000 / CONFIG_MIDDLEWARE_SAMPLE_RATE_HZ;
+    static constexpr uint32_t kTimerFrequency = 1000000;
+    static constexpr size_t kSamplesPerFrame = CONFIG_MIDDLEWARE_SAMPLES_PER_FRAME;
+    static constexpr uint32_t kReportSamples = 
+        CONFIG_MIDDLEWARE_RATE_REPORT_PERIOD * CONFIG_MIDDLEWARE_SAMPLE_RATE_HZ;
+
+    static inline TaskHandle_t streaming_task = nullptr;
+    static inline hw_timer_t *sample_timer = nullptr;
+    //alarms that came while the task was still busy with a sample
+    static inline uint32_t missed = 0;
+
+    static inline HandSnapshot samples[kSamplesPerFrame];
+    static inline uint8_t samples_frame[HandFrame::maxSize(kSamplesPerFrame)];
+    static_assert(sizeof(samples_frame) <= CONFIG_MQTT_TELEMETRY_SLOT_SIZE,
+        "a multi-sample frame must fit a telemetry lane slot, raise MQTT_TELEMETRY_SLOT_SIZE");
+
+    //time between samples and its deviation from the period, us
+    static inline Histogram<32, kSamplePeriodUs / 8> interval_histogram;
+    static inline Histogram<32, kSamplePeriodUs / 32> jitter_histogram;
+
+    //hardware timer alarm, wakes the streaming task
+    static void ARDUINO_ISR_ATTR onSampleTimer(){
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(streaming_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    //one sample per timer alarm, independent of how long sending takes
+    static void streamingTask (void *pvParameters){
+        uint32_t sequence = 0;
+        size_t count = 0;
+        int64_t last_us = 0;
+        int64_t report_start_us = esp_timer_get_time();
+        for(;;){
+            uint32_t alarms = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            if(alarms == 0){
+                continue;
             }
-            for(int i = 0; i < 
-                HandState::getStateExemplarsCount<Potentiometer::Potentiometer>(); 
-                    i++)
-            {
-                std::string message;
-                HandState::getState<Potentiometer::Potentiometer>(i).SerializeToString(&message);
-                MqttClient::getInstance().sendEnqueue(
-                    MQTT_TOPIC_MONITORING_IMU_RAW_DATA, 
-                    message.data(), 
-                    message.size(),
-                    CONFIG_MQTT_QOS_LEVEL,
-                    0,
-                    1
-                );
+            missed += alarms - 1;
+            int64_t now_us = esp_timer_get_time();
+            if(last_us != 0){
+                uint32_t interval = now_us - last_us;
+                interval_histogram.record(interval);
+                jitter_histogram.record(interval > kSamplePeriodUs ? 
+                    interval - kSamplePeriodUs : kSamplePeriodUs - interval);
             }
-            for(int i = 0; i < 
-                HandState::getStateExemplarsCount<Straingauge::StrainGuage>(); 
-                    i++)
+            last_us = now_us;
+
             {
-                std::string message;
-                HandState::getState<Straingauge::StrainGuage>(i).SerializeToString(&message);
-                MqttClient::getInstance().sendEnqueue(
-                    MQTT_TOPIC_MONITORING_IMU_RAW_DATA, 
-                    message.data(), 
-                    message.size(),
-                    CONFIG_MQTT_QOS_LEVEL,
-                    0,
-                    1
-                );
+                auto snapshot = HandState::snapshot();
+                samples[count] = *snapshot;
             }
-            for(int i = 0; i < 
-                HandState::getStateExemplarsCount<Servo::Servo>(); 
-                    i++)
-            {
-                std::string message;
-                HandState::getState<Servo::Servo>(i).SerializeToString(&message);
-                MqttClient::getInstance().sendEnqueue(
-                    MQTT_TOPIC_MONITORING_IMU_RAW_DATA, 
-                    message.data(), 
-                    message.size(),
-                    CONFIG_MQTT_QOS_LEVEL,
-                    0,
-                    1
+            samples[count].timestamp_us = now_us;
+
+            if(++count == kSamplesPerFrame){
+                count = 0;
+                size_t size = HandFrame::encodeSamples(
+                    samples, kSamplesPerFrame, kSamplePeriodUs, sequence++, 
+                    samples_frame, sizeof(samples_frame));
+                MqttClient::getInstance().sendTelemetry(
+                    MQTT_TOPIC_MONITORING_HAND_FRAME,
+                    samples_frame,
+                    size,
+                    kTelemetry.qos,
+                    kTelemetry.retain
                 );
             }
-            
-            vTaskDelay(pdMS_TO_TICKS
-                (CONFIG_MIDDLEWARE_SENDING_STATE_PERIOD));
+
+            if(interval_histogram.count() >= kReportSamples){
+                float seconds = (now_us - report_start_us) / 1e6f;
+                ESP_LOGI(TAG, "sampling at %.1f Hz, target %d Hz, missed %lu", 
+                    interval_histogram.count() / seconds, CONFIG_MIDDLEWARE_SAMPLE_RATE_HZ,
+                    (unsigned long)missed);
+                interval_histogram.log(TAG, "interval us");
+                jitter_histogram.log(TAG, "jitter us");
+                interval_histogram.reset();
+                jitter_histogram.reset();
+                report_start_us = now_us;
+            }
         }
     }
+#endif
+
 public:
     static void init(){
+#if defined(CONFIG_MIDDLEWARE_SPOOL) && !defined(CONFIG_MIDDLEWARE_HIGH_RATE)
+        spool.mount(CONFIG_MIDDLEWARE_SPOOL_PARTITION);
+#endif
+#ifdef CONFIG_MIDDLEWARE_HIGH_RATE
+        xTaskCreate(
+            streamingTask,
+            "MiddlewareTask",
+            4096,
+            nullptr,
+            5,
+            &streaming_task);
+        sample_timer = timerBegin(kTimerFrequency);
+        if(sample_timer == nullptr){
+            ESP_LOGE(TAG, "no hardware timer, high-rate streaming does not run");
+            return;
+        }
+        timerAttachInterrupt(sample_timer, onSampleTimer);
+        timerAlarm(sample_timer, kSamplePeriodUs, true, 0);
+#else
         xTaskCreate(
             sendingStateTask,
             "MiddlewareTask",
@@ -98,6 +271,6 @@ public:
             nullptr,
             5,
             nullptr);
+#endif
     }
 };
-
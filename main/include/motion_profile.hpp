@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "sdkconfig.h"
+
+/**
+ * @brief Jerk-limited (S-curve) move of one servo, precomputed as a table
+ *
+ * plan() samples the whole move once, with floating point, when a command
+ * starts it. at() is then a fixed-point table lookup with linear
+ * interpolation between samples: no float, no locks, safe in an ISR.
+ *
+ * The profile has seven phases, jerk, constant acceleration, jerk, cruise
+ * and the mirror image: acceleration and velocity are continuous, the
+ * peak velocity is 1.6 times the mean.
+ *
+ * Angles are Q8 fixed point degrees (kOne = 1 degree).
+ */
+class MotionProfile
+{
+public:
+    using Angle = int32_t;
+    static constexpr Angle kOne = 256;
+    static constexpr size_t kMaxSamples = CONFIG_TRAJECTORY_MAX_SAMPLES;
+
+    static_assert(kMaxSamples >= 2, "a profile needs both ends");
+    static_assert(CONFIG_SERVO_MAX_ANGLE * kOne <= UINT16_MAX, "samples are 16 bit");
+
+    /**
+     * @brief Sample a move, the previous one is discarded
+     *
+     * @param from Start angle, Q8, 0 to SERVO_MAX_ANGLE
+     * @param to Target angle, Q8, 0 to SERVO_MAX_ANGLE
+     * @param duration_us Move time, 0 - at() is the target right away
+     * @param period_us Evaluation period of the caller, samples are that
+     *                  far apart so evaluating on the period hits them.
+     *                  Longer moves use a multiple of it, at most kMaxSamples
+     */
+    void plan(Angle from, Angle to, uint32_t duration_us, uint32_t period_us);
+
+    /**
+     * @brief Angle of the move
+     *
+     * @param elapsed_us Time since the start of the move
+     * @return Angle Q8, the target from duration() on
+     */
+    Angle at(uint32_t elapsed_us) const
+    {
+        if (elapsed_us >= duration_us)
+        {
+            return samples[count - 1];
+        }
+        uint64_t position = (uint64_t(elapsed_us) * index_scale) >> 16; //Q16 sample index, floor
+        uint32_t idx = position >> 16;
+        int32_t fraction = (position & 0xFFFF) >> 4; //Q12, keeps the product in 32 bits
+        int32_t a = samples[idx];
+        int32_t b = samples[idx + 1];
+        return a + (((b - a) * fraction) >> 12);
+    }
+
+    Angle target() const
+    {
+        return samples[count - 1];
+    }
+
+    uint32_t duration() const
+    {
+        return duration_us;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    /**
+     * @brief Normalized profile, position 0 to 1 at time 0 to 1
+     */
+    static float shape(float u);
+
+private:
+    uint16_t samples[kMaxSamples] = {};
+    uint16_t count = 1;
+    uint32_t duration_us = 0;
+    uint64_t index_scale = 0; //1 / sample spacing, Q32
+};
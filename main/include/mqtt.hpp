@@ -4,9 +4,92 @@
 
 #include "mqtt_client.h"
 #include "esp_netif.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "small_mutex.hpp"
+
+#include <atomic>
 
 class MqttClient
 {
+#ifdef CONFIG_MQTT_RETAIN_TELEMETRY
+    static constexpr int kRetainTelemetry = 1;
+#else
+    static constexpr int kRetainTelemetry = 0;
+#endif
+#ifdef CONFIG_MQTT_RETAIN_STATE
+    static constexpr int kRetainState = 1;
+#else
+    static constexpr int kRetainState = 0;
+#endif
+#ifdef CONFIG_MQTT_RETAIN_NOTIFICATIONS
+    static constexpr int kRetainNotifications = 1;
+#else
+    static constexpr int kRetainNotifications = 0;
+#endif
+
+public:
+    struct ReconnectStats
+    {
+        uint32_t reconnects;          //connections restored after a loss
+        uint32_t attempts;            //reconnect attempts, failed ones included
+        int64_t last_connect_us;      //last attempt to its CONNACK
+        int64_t last_outage_us;       //last DISCONNECTED to CONNACK
+        int64_t disconnected_total_us; //sum of all outages
+    };
+
+    enum class Lane
+    {
+        Control,   //notifications, published right away
+        Telemetry, //published by the telemetry lane task within its budget
+    };
+
+    enum class TopicClass
+    {
+        Telemetry,     //delta and multi-sample frames, per-sensor topics
+        StateSnapshot, //keyframes and replayed frames
+        Notifications,
+        Commands,      //subscription only
+    };
+
+    struct TopicPolicy
+    {
+        int qos;
+        int retain;
+    };
+
+    /**
+     * @brief QoS and retain flag of a topic class, from MQTT_QOS_* and MQTT_RETAIN_*
+     */
+    static constexpr TopicPolicy policy(TopicClass topic_class)
+    {
+        switch (topic_class)
+        {
+        case TopicClass::Telemetry:
+            return {CONFIG_MQTT_QOS_TELEMETRY, kRetainTelemetry};
+        case TopicClass::StateSnapshot:
+            return {CONFIG_MQTT_QOS_STATE, kRetainState};
+        case TopicClass::Notifications:
+            return {CONFIG_MQTT_QOS_NOTIFICATIONS, kRetainNotifications};
+        case TopicClass::Commands:
+            return {CONFIG_MQTT_QOS_COMMANDS, 0};
+        }
+        return {0, 0};
+    }
+
+    struct LaneStats
+    {
+        uint32_t sent;
+        uint32_t dropped;          //telemetry: overwritten by newer messages, control: refused
+        uint32_t failed;           //publish returned an error
+        uint32_t depth;            //telemetry: waiting, control: awaiting PUBACK
+        uint32_t depth_high_water;
+        uint32_t queue_us_mean;    //from send call to the packet written
+        uint32_t queue_us_max;
+    };
+
 private:
     static MqttClient *p_instance;
     esp_mqtt_client_handle_t mqtt_client;
@@ -19,6 +102,60 @@ private:
     char *client_cert;
     char *key;
 
+    //time of the last CONNACK (esp_timer_get_time), for SUBACK and first command latency
+    int64_t connack_us = 0;
+    int subscribe_msg_id = -1;
+    bool awaiting_first_command = false;
+
+    //reconnect state, owned by the MQTT task except where atomic
+    TimerHandle_t reconnect_timer;
+    TaskHandle_t reconnect_task = nullptr;
+    std::atomic<bool> connected{false};
+    uint32_t reconnect_attempt = 0;
+    int64_t disconnected_at_us = 0;
+    //written by the reconnect task when an attempt starts
+    std::atomic<int64_t> attempt_us{0};
+    std::atomic<uint32_t> attempts{0};
+    ReconnectStats reconnect_stats = {};
+
+    //control lane, messages awaiting PUBACK, msg_id 0 - free slot
+    struct ControlMessage
+    {
+        int msg_id;
+        int64_t sent_us;
+    };
+    SmallMutex control_mutex;
+    ControlMessage control_inflight[CONFIG_MQTT_CONTROL_MAX_INFLIGHT] = {};
+    //PUBACKs no slot held, kept while a control publish is in its call: the
+    //PUBACK of that publish may come before the call returns its msg_id
+    static constexpr size_t kControlEarlyAcks = 2 * CONFIG_MQTT_CONTROL_MAX_INFLIGHT;
+    int control_early_acks[kControlEarlyAcks] = {};
+    uint32_t control_early_next = 0;
+    //slots reserved whose publish call has not returned
+    uint32_t control_publishing = 0;
+    LaneStats control_stats = {};
+    uint64_t control_queue_us_total = 0;
+
+    //telemetry lane, owned by the telemetry lane task
+    TaskHandle_t telemetry_task = nullptr;
+    LaneStats telemetry_stats = {};
+    uint64_t telemetry_queue_us_total = 0;
+    int64_t telemetry_tokens = CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S;
+    int64_t telemetry_refill_us = 0;
+
+    static void telemetryLaneTask(void *pvParameters);
+    void drainTelemetry();
+    void spendTelemetryBudget(size_t len);
+    int reserveControl(int64_t now_us);
+    void controlAcked(int msg_id);
+    void controlReset();
+    void logLanes();
+
+    static void reconnectTimerCallback(TimerHandle_t timer);
+    static void reconnectTask(void *pvParameters);
+    void scheduleReconnect();
+    void onConnected();
+
     MqttClient();
     ~MqttClient();
     MqttClient(const MqttClient &) {}
@@ -33,6 +170,16 @@ public:
     void subscribeTopics();
     int sendEnqueue(const char *topic, const char *data, int len, int qos, int retain, bool store);
     int send(const char *topic, const char *data, int len, int qos, int retain);
+    int sendControl(const char *topic, const char *data, int len);
+    bool sendTelemetry(const char *topic, const uint8_t *data, size_t len, int qos, int retain);
+    size_t telemetrySpace() const;
+    LaneStats getLaneStats(Lane lane) const;
+    ReconnectStats getReconnectStats() const;
+    //between CONNACK and the next MQTT_EVENT_DISCONNECTED
+    bool isConnected() const
+    {
+        return connected;
+    }
 
     //char *eventTypeToTopic(Notifications__EventType type);
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "motion_profile.hpp"
+#include "sdkconfig.h"
+
+/*
+---------------------------------------------------
+pressure controller
+---------------------------------------------------
+
+closes MoveToTargetPressure: one PI(D) loop per finger from its strain
+gauge to the angle of its servo, stepped by the control loop every tick
+(CONTROL_RATE_HZ) while the finger holds a pressure target.
+
+    angle = engage angle + Kp * e + Ki * sum(e * dt) - Kd * d(pressure) / dt
+
+    the derivative acts on the measurement, a new target does not kick
+    the angle moves at most CONTROL_MAX_SPEED_DEG_S (slew limit)
+    the integral stops while a limit holds the output in the direction
+    of the error (anti-windup)
+
+with SENSORS_ACQUISITION the gauges come from the newest sweep of the
+sensor acquisition (acquisition.hpp), which owns the multiplexers. a loop
+steps only on a tick that brings a new sweep. the gains count one step per
+tick, a sweep slower than the control period slows the loops as much. without
+it the control task samples only the strain gauge channels straight from
+the multiplexer ADC (acquire()), the multiplexers belong to the control
+task then.
+*/
+
+class PressureController
+{
+public:
+    using Angle = MotionProfile::Angle;
+
+    struct Stats
+    {
+        uint32_t steps;        //finger loop steps
+        uint32_t saturated;    //steps a limit held the output, integral frozen
+        uint32_t acquisitions; //gauge sweeps
+        uint32_t acquisition_us_max;
+    };
+
+    /**
+     * @brief Configure the multiplexer pins and the ADC, without SENSORS_ACQUISITION
+     */
+    static void init();
+
+    /**
+     * @brief Sample every strain gauge, without SENSORS_ACQUISITION
+     *
+     * @param pressures Readings in HandLayout order, kStrainGauges entries
+     */
+    static void acquire(uint16_t *pressures);
+
+    /**
+     * @brief Start holding a pressure, the loop starts from the current angle
+     *
+     * @param finger Finger, validated by the caller
+     * @param pressure Target, gauge units
+     * @param angle Current servo angle, Q8
+     */
+    static void engage(size_t finger, uint32_t pressure, Angle angle);
+
+    /**
+     * @brief One control period of a finger
+     *
+     * @param finger Engaged finger
+     * @param pressure Gauge reading of this period
+     * @param angle Servo angle of the last period, Q8
+     * @return Angle New servo angle, Q8
+     */
+    static Angle step(size_t finger, uint16_t pressure, Angle angle);
+
+    /**
+     * @brief Counters since init, written by the control task
+     */
+    static Stats stats();
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "small_mutex.hpp"
+
+/**
+ * @brief Publishes complete snapshots of T to concurrent readers
+ *
+ * Generalised triple buffer: MaxReaders + 2 copies of T. Readers pin the
+ * latest published copy and never block writers; a writer copies the latest
+ * snapshot into a copy nobody has pinned, modifies it and publishes it with
+ * a single index store. Readers therefore always see a snapshot produced by
+ * one complete write, never a mix of two.
+ *
+ * Writers are serialised by a SmallMutex among themselves. A writer only has
+ * to wait for readers if more than MaxReaders guards are held at once.
+ *
+ * @tparam T snapshot type, copy assignable
+ * @tparam MaxReaders number of guards that may be held simultaneously
+ */
+template <typename T, size_t MaxReaders>
+class SnapshotBuffer
+{
+    static constexpr size_t kBuffersCount = MaxReaders + 2;
+
+    T buffers[kBuffersCount];
+    // pin counters and the latest index use seq_cst: a reader pinning a copy
+    // and a writer checking the pin must not both miss each other
+    std::atomic<uint16_t> pins[kBuffersCount] = {};
+    std::atomic<uint8_t> latest{0};
+    std::atomic<uint32_t> published{0};
+    SmallMutex writers;
+
+public:
+    /**
+     * @brief Keeps a published snapshot alive while it is being read
+     */
+    class ReadGuard
+    {
+        const SnapshotBuffer *owner;
+        uint8_t idx;
+
+    public:
+        ReadGuard(const SnapshotBuffer *owner, uint8_t idx) : owner(owner), idx(idx) {}
+        ReadGuard(ReadGuard &&other) : owner(other.owner), idx(other.idx)
+        {
+            other.owner = nullptr;
+        }
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        ReadGuard &operator=(ReadGuard &&) = delete;
+
+        ~ReadGuard()
+        {
+            if (owner)
+            {
+                const_cast<SnapshotBuffer *>(owner)->pins[idx].fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        const T &operator*() const
+        {
+            return owner->buffers[idx];
+        }
+
+        const T *operator->() const
+        {
+            return &owner->buffers[idx];
+        }
+    };
+
+    /**
+     * @brief Pin the latest snapshot, lock-free
+     */
+    ReadGuard read() const
+    {
+        auto *self = const_cast<SnapshotBuffer *>(this);
+        for (;;)
+        {
+            uint8_t idx = latest.load();
+            self->pins[idx].fetch_add(1);
+            if (latest.load() == idx)
+            {
+                return ReadGuard(this, idx);
+            }
+            // a writer published meanwhile, the pinned copy may be reused
+            self->pins[idx].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Copy the latest snapshot, apply mutate to the copy and publish it
+     *
+     * @param mutate callable taking T &
+     */
+    template <typename F>
+    void write(F &&mutate)
+    {
+        writers.lock();
+        uint8_t current = latest.load(std::memory_order_relaxed);
+        uint8_t next = current;
+        while (next == current)
+        {
+            for (uint8_t i = 0; i < kBuffersCount; i++)
+            {
+                if (i != current && pins[i].load() == 0)
+                {
+                    next = i;
+                    break;
+                }
+            }
+            if (next == current)
+            {
+                taskYIELD();
+            }
+        }
+        buffers[next] = buffers[current];
+        mutate(buffers[next]);
+        latest.store(next);
+        published.fetch_add(1, std::memory_order_relaxed);
+        writers.unlock();
+    }
+
+    /**
+     * @brief Number of snapshots published so far
+     */
+    uint32_t version() const
+    {
+        return published.load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+/*
+---------------------------------------------------
+spool
+---------------------------------------------------
+
+a ring log of records in a flash partition, survives resets. telemetry is
+appended while the broker is unreachable and replayed after reconnecting.
+
+the partition is used as a ring of sectors, written one after the other
+and erased only when the head wraps around onto them, so every sector wears
+the same. every sector starts with a header:
+
+    uint32_t magic;
+    uint32_t sequence;  // increases with every sector written, the highest is the head
+
+followed by records, 4 byte aligned:
+
+    uint16_t length;    // payload bytes, 0xffff - free space
+    uint16_t state;     // 0xffff - pending, 0x0000 - replayed
+    uint32_t crc;       // crc32 of the payload
+    uint8_t payload[length];
+
+a record is marked replayed by programming its state to zero in place.
+records torn by a reset fail the crc and are skipped. when the ring is full
+the oldest sector is erased, pending records in it are lost.
+*/
+
+class Spool
+{
+public:
+    struct Stats
+    {
+        uint32_t appended;  //since mount
+        uint32_t replayed;  //since mount
+        uint32_t dropped;   //overwritten before being replayed
+        uint32_t corrupted; //skipped, crc mismatch
+        uint32_t erases;    //sectors erased since mount
+        uint32_t pending;   //records waiting for replay
+    };
+
+    /**
+     * @brief Find the partition and recover head and tail from flash
+     *
+     * @param label Partition label
+     * @return esp_err_t ESP_ERR_NOT_FOUND if there is no such partition
+     */
+    esp_err_t mount(const char *label);
+
+    bool mounted() const
+    {
+        return partition != nullptr;
+    }
+
+    /**
+     * @brief Append a record
+     *
+     * @return esp_err_t ESP_ERR_INVALID_SIZE if it does not fit in a sector
+     */
+    esp_err_t append(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Copy the oldest pending record
+     *
+     * @param buffer Output buffer
+     * @param size Output buffer size
+     * @return size_t Record size, 0 if nothing is pending or the buffer is too small
+     */
+    size_t peek(uint8_t *buffer, size_t size);
+
+    /**
+     * @brief Mark the record returned by peek() replayed
+     */
+    esp_err_t pop();
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+private:
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+    };
+
+    struct RecordHeader
+    {
+        uint16_t length;
+        uint16_t state;
+        uint32_t crc;
+    };
+
+    static constexpr uint32_t kMagic = 0x4C505352; //"RSPL"
+    static constexpr uint16_t kFree = 0xFFFF;
+    static constexpr uint16_t kPending = 0xFFFF;
+    static constexpr uint16_t kReplayed = 0x0000;
+
+    const esp_partition_t *partition = nullptr;
+    uint32_t sector_size = 0;
+    uint32_t sectors = 0;
+
+    //next record is written here
+    uint32_t head_sector = 0;
+    uint32_t head_offset = 0;
+    uint32_t head_sequence = 0;
+    //oldest pending record, equals head when nothing is pending
+    uint32_t tail_sector = 0;
+    uint32_t tail_offset = 0;
+    //size of the record returned by peek(), 0 - none
+    uint32_t peeked_size = 0;
+
+    Stats counters = {};
+
+    static uint32_t recordSize(uint32_t length)
+    {
+        return (sizeof(RecordHeader) + length + 3) & ~uint32_t(3);
+    }
+
+    bool readSector(uint32_t sector, SectorHeader &header);
+    //false at the end of the written part of the sector
+    bool readRecord(uint32_t sector, uint32_t offset, RecordHeader &header);
+    esp_err_t startSector(uint32_t sector, uint32_t sequence);
+    //mark the peeked record replayed and move past it
+    esp_err_t consume();
+    //move the tail past a record of size, 0 - to the next sector
+    void advanceTail(uint32_t size);
+    bool tailAtHead() const
+    {
+        return tail_sector == head_sector && tail_offset == head_offset;
+    }
+};
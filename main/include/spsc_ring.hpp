@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Cache line size used to keep producer and consumer state apart
+ */
+constexpr size_t kCacheLineSize = 64;
+
+/**
+ * @brief What SpscRing::push does when the ring is full
+ */
+enum class OverflowPolicy
+{
+    DropNewest, // reject the element being pushed
+    DropOldest, // overwrite the oldest unread element
+};
+
+/**
+ * @brief Fixed-capacity single-producer/single-consumer ring
+ *
+ * push() is wait-free. pop() is wait-free with DropNewest and lock-free with
+ * DropOldest (it retries when the producer overwrote the element being read).
+ * DropOldest lets the producer race the consumer on a slot, so it is only
+ * available for trivially copyable elements.
+ *
+ * @tparam T element type
+ * @tparam Capacity number of slots, power of two
+ * @tparam Policy overflow policy
+ */
+template <typename T, size_t Capacity, OverflowPolicy Policy = OverflowPolicy::DropNewest>
+class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+    static_assert(Policy != OverflowPolicy::DropOldest || std::is_trivially_copyable_v<T>,
+                  "DropOldest requires a trivially copyable element type");
+
+    static constexpr uint32_t kMask = Capacity - 1;
+
+    // written by the producer
+    alignas(kCacheLineSize) std::atomic<uint32_t> head{0};
+    // written by the consumer (and by the producer when dropping the oldest)
+    alignas(kCacheLineSize) std::atomic<uint32_t> tail{0};
+    // producer side statistics
+    alignas(kCacheLineSize) std::atomic<uint32_t> pushed{0};
+    std::atomic<uint32_t> dropped{0};
+    std::atomic<uint32_t> high_water{0};
+    alignas(kCacheLineSize) T slots[Capacity];
+
+    void copy(T &to, const T &from)
+    {
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+            std::memcpy(static_cast<void *>(&to), static_cast<const void *>(&from), sizeof(T));
+        }
+        else
+        {
+            to = from;
+        }
+    }
+
+public:
+    struct Stats
+    {
+        uint32_t pushed;     // accepted elements
+        uint32_t dropped;    // rejected (DropNewest) or overwritten (DropOldest) elements
+        uint32_t high_water; // maximal observed depth
+    };
+
+    /**
+     * @brief Push an element, producer side only
+     *
+     * @return true - element stored
+     * @return false - ring full, element dropped (DropNewest only)
+     */
+    bool push(const T &value)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        if (h - t == Capacity)
+        {
+            if constexpr (Policy == OverflowPolicy::DropNewest)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                // a failed exchange means the consumer freed the slot meanwhile
+                if (tail.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel))
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        copy(slots[h & kMask], value);
+        head.store(h + 1, std::memory_order_release);
+
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        uint32_t depth = h + 1 - tail.load(std::memory_order_relaxed);
+        if (depth > high_water.load(std::memory_order_relaxed))
+        {
+            high_water.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Pop the oldest element, consumer side only
+     *
+     * @return true - value holds the element
+     * @return false - ring empty
+     */
+    bool pop(T &value)
+    {
+        if constexpr (Policy == OverflowPolicy::DropNewest)
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            copy(value, slots[t & kMask]);
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+        else
+        {
+            for (;;)
+            {
+                uint32_t t = tail.load(std::memory_order_acquire);
+                if (t == head.load(std::memory_order_acquire))
+                {
+                    return false;
+                }
+                copy(value, slots[t & kMask]);
+                if (tail.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Number of unread elements, exact only when called from producer or consumer
+     */
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+
+    Stats stats() const
+    {
+        return {
+            pushed.load(std::memory_order_relaxed),
+            dropped.load(std::memory_order_relaxed),
+            high_water.load(std::memory_order_relaxed),
+        };
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @brief Maps MQTT topics to route indexes without building strings
+ *
+ * Built at compile time from the routed topics, which all start with one
+ * prefix. The suffixes after the prefix are hashed (FNV-1a) into a table
+ * with a seed searched so that no two suffixes share a slot, a perfect
+ * hash. A lookup compares the prefix, hashes the suffix once and confirms
+ * the single candidate with one memcmp.
+ *
+ * static constexpr TopicDispatcher<2> dispatcher("a/", {"a/x", "a/y"});
+ * static_assert(dispatcher.valid());
+ * int route = dispatcher.find(topic, topic_len); // 0, 1 or -1
+ *
+ * @tparam N number of routed topics
+ */
+template <size_t N>
+class TopicDispatcher
+{
+    static_assert(N > 0 && N < 0xFF, "route index is stored in a byte");
+
+    static constexpr size_t kSlots = std::bit_ceil(N * 2 < 8 ? size_t(8) : N * 2);
+    static constexpr uint32_t kMaxSeed = 1024;
+
+    std::string_view prefix;
+    std::array<std::string_view, N> suffixes = {};
+    uint32_t seed = 0;
+    //route index + 1, 0 - empty slot
+    std::array<uint8_t, kSlots> slots = {};
+    bool built = false;
+
+    constexpr bool tryBuild(uint32_t candidate)
+    {
+        slots = {};
+        for (size_t i = 0; i < N; i++)
+        {
+            size_t slot = hash(suffixes[i].data(), suffixes[i].size(), candidate) & (kSlots - 1);
+            if (slots[slot] != 0)
+            {
+                return false;
+            }
+            slots[slot] = i + 1;
+        }
+        seed = candidate;
+        return true;
+    }
+
+public:
+    //FNV-1a, the seed is mixed into the offset basis
+    static constexpr uint32_t hash(const char *data, size_t len, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (size_t i = 0; i < len; i++)
+        {
+            h = (h ^ uint8_t(data[i])) * 16777619u;
+        }
+        return h;
+    }
+
+    /**
+     * @param prefix common beginning of all topics
+     * @param topics routed topics, the position is the route index
+     */
+    constexpr TopicDispatcher(std::string_view prefix, const std::array<std::string_view, N> &topics)
+        : prefix(prefix)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            if (topics[i].substr(0, prefix.size()) != prefix || topics[i].size() == prefix.size())
+            {
+                return;
+            }
+            suffixes[i] = topics[i].substr(prefix.size());
+            for (size_t j = 0; j < i; j++)
+            {
+                if (suffixes[j] == suffixes[i])
+                {
+                    return;
+                }
+            }
+        }
+        for (uint32_t candidate = 0; candidate < kMaxSeed && !built; candidate++)
+        {
+            built = tryBuild(candidate);
+        }
+    }
+
+    //false if a topic lacks the prefix, topics repeat or no perfect hash was found
+    constexpr bool valid() const
+    {
+        return built;
+    }
+
+    /**
+     * @brief Find the route of a topic
+     *
+     * @param topic Topic bytes, not null terminated
+     * @param len Topic length
+     * @return int Route index, -1 if the topic is not routed
+     */
+    int find(const char *topic, size_t len) const
+    {
+        if (len <= prefix.size() || memcmp(topic, prefix.data(), prefix.size()) != 0)
+        {
+            return -1;
+        }
+        const char *suffix = topic + prefix.size();
+        size_t suffix_len = len - prefix.size();
+        uint8_t route = slots[hash(suffix, suffix_len, seed) & (kSlots - 1)];
+        if (route == 0)
+        {
+            return -1;
+        }
+        route--;
+        if (suffixes[route].size() != suffix_len || memcmp(suffix, suffixes[route].data(), suffix_len) != 0)
+        {
+            return -1;
+        }
+        return route;
+    }
+};
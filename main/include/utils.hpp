@@ -1,10 +1,34 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
 #include <inttypes.h>
 
 std::string format(const char *fmt, ...);
 
 uint8_t *strMacToArray(const char *mac_str);
 
-int calcSHA256(std::string input, unsigned char *hash);
\ No newline at end of file
+int calcSHA256(std::string input, unsigned char *hash);
+
+/**
+ * @brief Serialize a protobuf message into a caller provided buffer, without heap allocation
+ *
+ * @param message Protobuf message
+ * @param buffer Output buffer, one byte longer than the message
+ * @return size_t Serialized size, 0 if the message does not fit
+ */
+template <typename Message, size_t N>
+size_t serializeToBuffer(const Message &message, uint8_t (&buffer)[N])
+{
+    size_t size = message.ByteSizeLong();
+    if (size >= N)
+    {
+        buffer[0] = 0;
+        return 0;
+    }
+    //sizes are cached by ByteSizeLong
+    message.SerializeWithCachedSizesToArray(buffer);
+    //esp-mqtt takes strlen(data) as the length of an empty payload
+    buffer[size] = 0;
+    return size;
+}
@@ -6,6 +6,8 @@
 #include "nvs.hpp"
 #include "internal_api.hpp"
 #include "middleware.hpp"
+#include "control.hpp"
+#include "acquisition.hpp"
 
 const char * TAG = "NVS_TAG";
 
@@ -27,9 +29,13 @@ extern "C" void app_main(void)
     }
     ESP_LOGI(TAG, "nvs_flash_init: 0x%04x", ret);
     wifi_init_sta();
-    HandState::init(3, 1, 21, 5, 6); 
 
     //todo parameters
+#ifdef CONFIG_SENSORS_ACQUISITION
+    SensorAcquisition::init();
+#endif
+    //the commands consumer runs before commands can arrive
+    ControlLoop::init();
     MqttClient::init();
     MiddleWare::init();
     
@@ -24,13 +24,13 @@ esp_err_t digitalWrite(uint8_t gpio, bool level){
 
 
 MUX74HC4067::MUX74HC4067(uint8_t en, int8_t s0, int8_t s1, int8_t s2, int8_t s3)
-    : enable_pin_(en),
+    : signal_pin_status_(-1),
+      signal_mode_(0),
+      num_of_control_pins_(1),
       enable_status_(DISABLED),
-      signal_pin_status_(-1),
+      enable_pin_(en),
       signal_pin_(-1),
-      signal_mode_(0),
-      current_channel_(0),
-      num_of_control_pins_(1) {
+      current_channel_(0) {
   pinMode(en, OUTPUT);
   digitalWrite(en, HIGH);  // Initially disables the connection of the SIG pin
                            // to the channels
@@ -42,9 +42,37 @@ MUX74HC4067::MUX74HC4067(uint8_t en, int8_t s0, int8_t s1, int8_t s2, int8_t s3)
   for (uint8_t i = 0; i < num_of_control_pins_; ++i) {
     pinMode(control_pin_[i], OUTPUT);
   }
+
+  // set and clear masks of every channel, a switch is up to four register writes
+  register_write_ = GpioOut::fits(en);
+  enable_mask_ = GpioOut::mask(en);
+  select_mask_ = 0;
+  for (uint8_t i = 0; i < num_of_control_pins_; ++i) {
+    register_write_ = register_write_ && GpioOut::fits(control_pin_[i]);
+    select_mask_ |= GpioOut::mask(control_pin_[i]);
+  }
+  for (uint8_t chan = 0; chan < 16; ++chan) {
+    channel_mask_[chan] = 0;
+    for (uint8_t i = 0; i < num_of_control_pins_; ++i) {
+      if ((chan >> i) & 0x01) channel_mask_[chan] |= GpioOut::mask(control_pin_[i]);
+    }
+  }
 }
 
 void MUX74HC4067::setChannel(int8_t pin, uint8_t set) {
+  if (register_write_) {
+    // EN high, the select lines, EN low, each a write of its own: the
+    // connection is off before the first select line moves and comes back
+    // only after the last one settled
+    current_channel_ = pin;
+    enable_status_ = ENABLED;
+    uint32_t ones = channel_mask_[pin & 0x0F];
+    GpioOut{enable_mask_, 0}.write();
+    GpioOut{ones, select_mask_ & ~ones}.write();
+    if (set == ENABLED) GpioOut{0, enable_mask_}.write();
+    return;
+  }
+
   digitalWrite(enable_pin_, HIGH);
   current_channel_ = pin;
   for (uint8_t i = 0; i < num_of_control_pins_; ++i) {
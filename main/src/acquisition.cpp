@@ -0,0 +1,603 @@
+#include "acquisition.hpp"
+#include "Arduino.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gpio_out.hpp"
+#include "histogram.hpp"
+#include "soc/soc_caps.h"
+#include "spsc_ring.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <utility>
+
+static const char *TAG = "ACQUISITION";
+
+//select line writes of every channel of every mux
+static constexpr auto kSelect = []()
+{
+    std::array<std::array<GpioOut, HandTopology::kMuxChannels>, HandTopology::kMuxesCount> select = {};
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        const HandTopology::Mux &pins = HandTopology::kMuxes[mux];
+        const uint8_t lines[] = {pins.s0, pins.s1, pins.s2, pins.s3};
+        for (size_t channel = 0; channel < HandTopology::kMuxChannels; channel++)
+        {
+            for (size_t bit = 0; bit < std::size(lines); bit++)
+            {
+                (channel >> bit & 1 ? select[mux][channel].set : select[mux][channel].clear) |= GpioOut::mask(lines[bit]);
+            }
+        }
+    }
+    return select;
+}();
+
+static constexpr bool muxPinsFit()
+{
+    for (auto &pins : HandTopology::kMuxes)
+    {
+        for (uint8_t pin : {pins.en, pins.s0, pins.s1, pins.s2, pins.s3})
+        {
+            if (!GpioOut::fits(pin))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(muxPinsFit(), "multiplexer pins must be GPIO 0-31, they are switched by register writes");
+
+//channel currently selected on every mux, kMuxChannels - unknown
+static uint8_t selected[HandTopology::kMuxesCount];
+//cycles of a channel switch, register writes and digitalWrite per line
+static uint32_t select_cycles = 0;
+static uint32_t select_cycles_digital_write = 0;
+
+/**
+ * @brief Time a channel switch both ways, once over every channel of the first mux
+ */
+static void measureSelect()
+{
+    const HandTopology::Mux &pins = HandTopology::kMuxes[0];
+    const uint8_t lines[] = {pins.s0, pins.s1, pins.s2, pins.s3};
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    for (size_t channel = 0; channel < HandTopology::kMuxChannels; channel++)
+    {
+        for (size_t bit = 0; bit < std::size(lines); bit++)
+        {
+            digitalWrite(lines[bit], channel >> bit & 1);
+        }
+    }
+    select_cycles_digital_write = (esp_cpu_get_cycle_count() - start) / HandTopology::kMuxChannels;
+
+    start = esp_cpu_get_cycle_count();
+    for (size_t channel = 0; channel < HandTopology::kMuxChannels; channel++)
+    {
+        kSelect[0][channel].write();
+    }
+    select_cycles = (esp_cpu_get_cycle_count() - start) / HandTopology::kMuxChannels;
+    ESP_LOGI(TAG, "channel switch: %lu cycles, %lu with digitalWrite per line",
+             (unsigned long)select_cycles, (unsigned long)select_cycles_digital_write);
+}
+
+void SensorAcquisition::configure()
+{
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        const HandTopology::Mux &pins = HandTopology::kMuxes[mux];
+        for (uint8_t pin : {pins.en, pins.s0, pins.s1, pins.s2, pins.s3})
+        {
+            pinMode(pin, OUTPUT);
+        }
+        //enable is active low, the mux stays enabled
+        digitalWrite(pins.en, LOW);
+    }
+    analogReadResolution(12);
+    measureSelect();
+    std::fill(std::begin(selected), std::end(selected), HandTopology::kMuxChannels);
+}
+
+void SensorAcquisition::select(uint8_t mux, uint8_t channel)
+{
+    if (selected[mux] == channel)
+    {
+        return;
+    }
+    kSelect[mux][channel].write();
+    selected[mux] = channel;
+}
+
+#ifdef CONFIG_SENSORS_ACQUISITION
+
+using HandTopology::AcquisitionSlot;
+using HandTopology::SensorKind;
+
+//sweeps the control loop may fall behind by, older ones are overwritten
+static constexpr size_t kRingDepth = 8;
+
+//schedule of one mux padded to kMuxChannels, the muxes step together
+struct MuxSchedule
+{
+    AcquisitionSlot slots[HandTopology::kMuxChannels];
+    uint8_t count;
+};
+
+template <size_t N>
+static constexpr MuxSchedule pad(const std::array<AcquisitionSlot, N> &slots)
+{
+    MuxSchedule schedule = {};
+    for (size_t i = 0; i < N; i++)
+    {
+        schedule.slots[i] = slots[i];
+    }
+    schedule.count = N;
+    return schedule;
+}
+
+template <size_t... Mux>
+static constexpr std::array<MuxSchedule, sizeof...(Mux)> schedules(std::index_sequence<Mux...>)
+{
+    return {pad(HandTopology::acquisitionSchedule<Mux>())...};
+}
+
+static constexpr auto kSchedules = schedules(std::make_index_sequence<HandTopology::kMuxesCount>());
+
+//steps of a sweep, the longest schedule
+static constexpr size_t kSweepSteps = []()
+{
+    size_t steps = 0;
+    for (auto &schedule : kSchedules)
+    {
+        steps = std::max<size_t>(steps, schedule.count);
+    }
+    return steps;
+}();
+
+static_assert(kSweepSteps > 0, "no sensor behind a multiplexer");
+
+static SpscRing<SensorAcquisition::Sweep, kRingDepth, OverflowPolicy::DropOldest> sweeps;
+//sweep being filled
+static SensorAcquisition::Sweep filling;
+//slot of every schedule selected by the last step
+static uint8_t position = 0;
+
+static TaskHandle_t acquisition_task = nullptr;
+
+//written by the acquisition task or the conversion done interrupt only
+static SensorAcquisition::Stats counters = {};
+//copy of counters for other tasks, published after every step under the lock
+static SensorAcquisition::Stats published = {};
+static portMUX_TYPE published_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Select the slot at position on every multiplexer
+ */
+static void selectPosition()
+{
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        const MuxSchedule &schedule = kSchedules[mux];
+        if (position < schedule.count)
+        {
+            SensorAcquisition::select(mux, schedule.slots[position].channel);
+        }
+    }
+}
+
+/**
+ * @brief Store the readings of the selected slots, select the next ones
+ *
+ * @param raw Reading of every multiplexer, unused past the end of its schedule
+ * @param now_us Step time
+ */
+static void collect(const uint16_t *raw, int64_t now_us)
+{
+    if (position == 0)
+    {
+        filling.timestamp_us = now_us;
+    }
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        const MuxSchedule &schedule = kSchedules[mux];
+        if (position < schedule.count)
+        {
+            const AcquisitionSlot &slot = schedule.slots[position];
+            if (slot.kind == SensorKind::Potentiometer)
+            {
+                filling.potentiometers[slot.slot] = raw[mux];
+            }
+            else
+            {
+                filling.straingauges[slot.slot] = raw[mux];
+            }
+            counters.samples++;
+        }
+    }
+    if (++position == kSweepSteps)
+    {
+        position = 0;
+        sweeps.push(filling);
+        counters.sweeps++;
+    }
+    selectPosition();
+}
+
+#ifdef CONFIG_SENSORS_ADC_DMA
+
+static constexpr uint32_t kSampleRate = CONFIG_SENSORS_DMA_SAMPLE_RATE_HZ;
+static constexpr uint32_t kConversions = CONFIG_SENSORS_DMA_CONVERSIONS;
+static constexpr uint32_t kDiscard = CONFIG_SENSORS_DMA_DISCARD;
+//one channel of every mux, the pattern converts the mux outputs in turn
+static constexpr uint32_t kFrameBytes = kConversions * HandTopology::kMuxesCount * SOC_ADC_DIGI_RESULT_BYTES;
+static constexpr uint32_t kFrameUs = uint64_t(kConversions) * HandTopology::kMuxesCount * 1000000 / kSampleRate;
+//the discarded conversions, the switch must come before they end
+static constexpr uint32_t kDiscardUs = uint64_t(kDiscard) * HandTopology::kMuxesCount * 1000000 / kSampleRate;
+
+static_assert(kDiscard < kConversions, "SENSORS_DMA_DISCARD leaves no conversion to average");
+static_assert(kFrameBytes % SOC_ADC_DIGI_DATA_BYTES_PER_CONV == 0 && kFrameBytes <= 4092,
+              "ADC conversion frame size not supported");
+static_assert(HandTopology::kMuxesCount <= SOC_ADC_PATT_LEN_MAX, "more multiplexers than ADC pattern entries");
+
+static adc_continuous_handle_t adc = nullptr;
+//mux behind every ADC1 channel, kMuxesCount - none
+static uint8_t channel_mux[SOC_ADC_MAX_CHANNEL_NUM];
+
+/**
+ * @brief Average the conversions of a frame, store them and select the next channel
+ *
+ * @param edata DMA frame
+ */
+static void convert(const adc_continuous_evt_data_t *edata)
+{
+    //time of the last frame, frames still to skip
+    static int64_t last_us = 0;
+    static uint32_t skip = 0;
+    int64_t now_us = esp_timer_get_time();
+    counters.steps++;
+    if (edata->size != kFrameBytes)
+    {
+        return;
+    }
+    uint32_t late = last_us != 0 && now_us - last_us > kFrameUs ? now_us - last_us - kFrameUs : 0;
+    last_us = now_us;
+    if (skip > 0)
+    {
+        //converted before the switch, the previous channel
+        skip--;
+        counters.overruns++;
+        return;
+    }
+    //the ADC converts on the old channel until the switch below, frames
+    //whose averaged conversions started before it are skipped
+    skip = late / kFrameUs + (late % kFrameUs > kDiscardUs ? 1 : 0);
+    counters.jitter_us_max = std::max(counters.jitter_us_max, late);
+    counters.settle_us_min = std::min(counters.settle_us_min, late < kDiscardUs ? kDiscardUs - late : 0);
+
+    uint32_t sums[HandTopology::kMuxesCount] = {};
+    uint32_t seen[HandTopology::kMuxesCount] = {};
+    for (uint32_t offset = 0; offset < kFrameBytes; offset += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        auto *result = reinterpret_cast<const adc_digi_output_data_t *>(edata->conv_frame_buffer + offset);
+        uint32_t channel = result->type2.channel;
+        uint8_t mux = channel < SOC_ADC_MAX_CHANNEL_NUM ? channel_mux[channel] : HandTopology::kMuxesCount;
+        if (mux == HandTopology::kMuxesCount)
+        {
+            continue;
+        }
+        if (seen[mux]++ < kDiscard)
+        {
+            counters.discarded++;
+            continue;
+        }
+        sums[mux] += result->type2.data;
+    }
+    uint16_t raw[HandTopology::kMuxesCount];
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        uint32_t averaged = seen[mux] > kDiscard ? seen[mux] - kDiscard : 1;
+        raw[mux] = (sums[mux] + averaged / 2) / averaged;
+    }
+    collect(raw, now_us);
+
+    uint32_t step_us = esp_timer_get_time() - now_us;
+    counters.step_us_max = std::max(counters.step_us_max, step_us);
+    counters.busy_us += step_us;
+}
+
+/**
+ * @brief Conversion done interrupt, one DMA frame: one channel of every multiplexer
+ *
+ * Not in IRAM, it selects through kSelect in flash: without
+ * ADC_CONTINUOUS_ISR_IRAM_SAFE the driver does not run it while the cache
+ * is disabled
+ *
+ * @return false - no task woken
+ */
+static bool onConversions(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    convert(edata);
+    portENTER_CRITICAL_ISR(&published_lock);
+    published = counters;
+    portEXIT_CRITICAL_ISR(&published_lock);
+    return false;
+}
+
+/**
+ * @brief ADC1 continuous conversions of every multiplexer output
+ *
+ * The interrupt is allocated on the calling core
+ */
+static esp_err_t startConversions()
+{
+    adc_digi_pattern_config_t pattern[HandTopology::kMuxesCount] = {};
+    std::fill(std::begin(channel_mux), std::end(channel_mux), HandTopology::kMuxesCount);
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        uint8_t sig = HandTopology::kMuxes[mux].sig;
+        adc_unit_t unit;
+        adc_channel_t channel;
+        if (adc_continuous_io_to_channel(sig, &unit, &channel) != ESP_OK || unit != ADC_UNIT_1)
+        {
+            ESP_LOGE(TAG, "multiplexer %u: pin %u is not an ADC1 pin", (unsigned)mux, (unsigned)sig);
+            return ESP_ERR_INVALID_ARG;
+        }
+        pattern[mux].atten = ADC_ATTEN_DB_12;
+        pattern[mux].channel = channel;
+        pattern[mux].unit = ADC_UNIT_1;
+        pattern[mux].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        channel_mux[channel] = mux;
+    }
+
+    //the readings are taken in the interrupt, nothing reads the pool. the
+    //driver of ESP-IDF 5.1 (Arduino 3.0) calls on_conv_done for every frame
+    //and only fails to copy it into the full pool (on_pool_ovf: "newer
+    //conversion results will be discarded"), the conversions go on. the
+    //smallest pool then costs no memory, acquisitionTask checks the frames
+    //keep coming once it is full
+    adc_continuous_handle_cfg_t handle_config = {};
+    handle_config.max_store_buf_size = kFrameBytes;
+    handle_config.conv_frame_size = kFrameBytes;
+
+    adc_continuous_config_t config = {};
+    config.pattern_num = HandTopology::kMuxesCount;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = kSampleRate;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+
+    adc_continuous_evt_cbs_t callbacks = {};
+    callbacks.on_conv_done = onConversions;
+
+    esp_err_t err = adc_continuous_new_handle(&handle_config, &adc);
+    if (err == ESP_OK)
+    {
+        err = adc_continuous_config(adc, &config);
+    }
+    if (err == ESP_OK)
+    {
+        err = adc_continuous_register_event_callbacks(adc, &callbacks, nullptr);
+    }
+    if (err == ESP_OK)
+    {
+        err = adc_continuous_start(adc);
+    }
+    return err;
+}
+
+/**
+ * @brief Starts the conversions on its core, then only reports
+ *
+ * @param pvParameters Unused
+ */
+static void acquisitionTask(void *pvParameters)
+{
+    esp_err_t err = startConversions();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ADC continuous mode: %s, sensors are not sampled", esp_err_to_name(err));
+        vTaskDelete(nullptr);
+        return;
+    }
+    ESP_LOGI(TAG, "%u sensors on %u multiplexers, sweep of %u channels every %lu us, %lu of %lu conversions averaged",
+             (unsigned)HandTopology::kSensorsCount, (unsigned)HandTopology::kMuxesCount, (unsigned)kSweepSteps,
+             (unsigned long)(kSweepSteps * kFrameUs), (unsigned long)(kConversions - kDiscard),
+             (unsigned long)kConversions);
+
+    //the pool is full after the first frame, the interrupts must go on
+    int64_t started_us = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    uint32_t expected = (esp_timer_get_time() - started_us) / kFrameUs;
+    uint32_t frames = SensorAcquisition::stats().steps;
+    if (frames < expected / 2)
+    {
+        ESP_LOGE(TAG, "%lu conversion frames in %lu expected, the driver stops with a full pool",
+                 (unsigned long)frames, (unsigned long)expected);
+    }
+    if (CONFIG_SENSORS_REPORT_PERIOD == 0)
+    {
+        vTaskDelete(nullptr);
+        return;
+    }
+
+    int64_t report_start_us = esp_timer_get_time();
+    SensorAcquisition::Stats reported = {};
+    for (;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SENSORS_REPORT_PERIOD * 1000));
+        SensorAcquisition::Stats stats = SensorAcquisition::stats();
+        int64_t now_us = esp_timer_get_time();
+        float seconds = (now_us - report_start_us) / 1e6f;
+        ESP_LOGI(TAG, "%.0f samples/s, %.1f sweeps/s, CPU %.1f%%, frames skipped %lu, dropped sweeps %lu, late max %lu us, settle min %lu us, interrupt max %lu us",
+                 (stats.samples - reported.samples) / seconds, (stats.sweeps - reported.sweeps) / seconds,
+                 (stats.busy_us - reported.busy_us) / seconds / 1e4f, (unsigned long)stats.overruns,
+                 (unsigned long)stats.dropped, (unsigned long)stats.jitter_us_max, (unsigned long)stats.settle_us_min,
+                 (unsigned long)stats.step_us_max);
+        reported = stats;
+        report_start_us = now_us;
+    }
+}
+
+void SensorAcquisition::init()
+{
+    configure();
+    position = 0;
+    selectPosition();
+    counters = {};
+    counters.settle_us_min = UINT32_MAX;
+    published = counters;
+
+    //the interrupt takes the place of the task, the task only reports
+    xTaskCreatePinnedToCore(acquisitionTask, "AcquisitionTask", 3072, nullptr, 2, &acquisition_task, CONFIG_SENSORS_CORE);
+}
+
+#else
+
+static constexpr uint32_t kStepUs = CONFIG_SENSORS_SETTLE_US;
+static constexpr uint32_t kTimerFrequency = 1000000;
+static constexpr uint32_t kReportSteps = CONFIG_SENSORS_REPORT_PERIOD * (1000000 / kStepUs);
+
+static hw_timer_t *acquisition_timer = nullptr;
+
+//written by the acquisition task only
+static Histogram<32, std::max<uint32_t>(kStepUs / 16, 1)> jitter_histogram;
+
+/**
+ * @brief One step of the sweep on every multiplexer at once
+ *
+ * @param now_us Step time
+ */
+static void step(int64_t now_us)
+{
+    uint16_t raw[HandTopology::kMuxesCount] = {};
+    for (size_t mux = 0; mux < HandTopology::kMuxesCount; mux++)
+    {
+        if (position < kSchedules[mux].count)
+        {
+            raw[mux] = analogRead(HandTopology::kMuxes[mux].sig);
+        }
+    }
+    collect(raw, now_us);
+}
+
+/**
+ * @brief Hardware timer alarm, wakes the acquisition task
+ */
+static void ARDUINO_ISR_ATTR onTimer()
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(acquisition_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief Acquisition task, one step per timer alarm
+ *
+ * @param pvParameters Unused
+ */
+static void acquisitionTask(void *pvParameters)
+{
+    int64_t last_us = 0;
+    int64_t report_start_us = esp_timer_get_time();
+    SensorAcquisition::Stats reported = {};
+    for (;;)
+    {
+        uint32_t alarms = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (alarms == 0)
+        {
+            continue;
+        }
+        int64_t now_us = esp_timer_get_time();
+        //more than one alarm: the last step ran into the next period
+        counters.overruns += alarms - 1;
+        counters.steps++;
+        if (last_us != 0)
+        {
+            uint32_t interval = now_us - last_us;
+            uint32_t expected = alarms * kStepUs;
+            uint32_t jitter = interval > expected ? interval - expected : expected - interval;
+            jitter_histogram.record(jitter);
+            counters.jitter_us_max = std::max(counters.jitter_us_max, jitter);
+            counters.settle_us_min = std::min(counters.settle_us_min, interval);
+        }
+        last_us = now_us;
+
+        step(now_us);
+        uint32_t step_us = esp_timer_get_time() - now_us;
+        counters.step_us_max = std::max(counters.step_us_max, step_us);
+        counters.busy_us += step_us;
+        portENTER_CRITICAL(&published_lock);
+        published = counters;
+        portEXIT_CRITICAL(&published_lock);
+
+        if (kReportSteps != 0 && counters.steps % kReportSteps == 0)
+        {
+            float seconds = (now_us - report_start_us) / 1e6f;
+            ESP_LOGI(TAG, "%.0f samples/s, %.1f sweeps/s, overruns %lu, dropped sweeps %lu, settle min %lu us, step max %lu us",
+                     (counters.samples - reported.samples) / seconds, (counters.sweeps - reported.sweeps) / seconds,
+                     (unsigned long)counters.overruns, (unsigned long)sweeps.stats().dropped,
+                     (unsigned long)counters.settle_us_min, (unsigned long)counters.step_us_max);
+            jitter_histogram.log(TAG, "step jitter us");
+            jitter_histogram.reset();
+            reported = counters;
+            report_start_us = now_us;
+        }
+    }
+}
+
+void SensorAcquisition::init()
+{
+    configure();
+    position = 0;
+    selectPosition();
+    counters = {};
+    counters.settle_us_min = UINT32_MAX;
+    published = counters;
+
+    //above the control task: a step is short and its timing is the settle time
+    xTaskCreatePinnedToCore(acquisitionTask, "AcquisitionTask", 3072, nullptr, 11, &acquisition_task, CONFIG_SENSORS_CORE);
+
+    acquisition_timer = timerBegin(kTimerFrequency);
+    if (acquisition_timer == nullptr)
+    {
+        ESP_LOGE(TAG, "no hardware timer, sensors are not sampled");
+        return;
+    }
+    timerAttachInterrupt(acquisition_timer, onTimer);
+    timerAlarm(acquisition_timer, kStepUs, true, 0);
+    ESP_LOGI(TAG, "%u sensors on %u multiplexers, sweep of %u steps every %lu us",
+             (unsigned)HandTopology::kSensorsCount, (unsigned)HandTopology::kMuxesCount, (unsigned)kSweepSteps,
+             (unsigned long)(kSweepSteps * kStepUs));
+}
+
+#endif
+
+bool SensorAcquisition::latest(Sweep &sweep)
+{
+    bool any = false;
+    while (sweeps.pop(sweep))
+    {
+        any = true;
+    }
+    return any;
+}
+
+SensorAcquisition::Stats SensorAcquisition::stats()
+{
+    //the interrupt may run on the other core
+    portENTER_CRITICAL(&published_lock);
+    Stats stats = published;
+    portEXIT_CRITICAL(&published_lock);
+    stats.dropped = sweeps.stats().dropped;
+    stats.select_cycles = select_cycles;
+    stats.select_cycles_digital_write = select_cycles_digital_write;
+    return stats;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "command_types.hpp"
+
+#include <algorithm>
+#include <limits>
+
+/**
+ * @brief Narrow an index, out of range values become kInvalidIndex
+ */
+static uint8_t narrowIndex(uint32_t value)
+{
+    return value < Command::kInvalidIndex ? static_cast<uint8_t>(value) : Command::kInvalidIndex;
+}
+
+/**
+ * @brief Narrow a value, out of range values saturate
+ */
+static uint16_t narrowValue(uint32_t value)
+{
+    return static_cast<uint16_t>(std::min<uint32_t>(value, std::numeric_limits<uint16_t>::max()));
+}
+
+Command::ServoGoToAngle Command::decode(const Commands::ServoGoToAngle &message)
+{
+    return {narrowIndex(message.servo()), narrowValue(message.angle())};
+}
+
+Command::ServoLock Command::decode(const Commands::ServoLock &message)
+{
+    return {narrowIndex(message.servo())};
+}
+
+Command::ServoUnLock Command::decode(const Commands::ServoUnLock &message)
+{
+    return {narrowIndex(message.servo())};
+}
+
+Command::ServoSmoothlyMove Command::decode(const Commands::ServoSmoothlyMove &message)
+{
+    return {narrowIndex(message.servo()), narrowValue(message.angle()), message.duration()};
+}
+
+Command::MoveToTargetPressure Command::decode(const Commands::MoveToTargetPressure &message)
+{
+    return {narrowIndex(message.finger()), message.pressure()};
+}
+
+Command::HoldGesture Command::decode(const Commands::HoldGesture &message)
+{
+    HoldGesture command = {};
+    command.gesture = narrowIndex(message.gesture());
+    command.angles_count = static_cast<uint8_t>(
+        std::min<size_t>(message.angles_size(), kMaxGestureAngles));
+    for (uint8_t i = 0; i < command.angles_count; i++)
+    {
+        command.angles[i] = narrowValue(message.angles(i));
+    }
+    return command;
+}
@@ -0,0 +1,499 @@
+#include "control.hpp"
+#include "Arduino.h"
+#include "acquisition.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "gestures.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "hand_topology.hpp"
+#include "histogram.hpp"
+#include "internal_api.hpp"
+#include "motion_profile.hpp"
+#include "pressure.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+static const char *TAG = "CONTROL";
+
+static constexpr uint32_t kTickPeriodUs = 1000000 / CONFIG_CONTROL_RATE_HZ;
+static constexpr uint32_t kTimerFrequency = 1000000;
+static constexpr int64_t kDeadlineUs = CONFIG_CONTROL_COMMAND_DEADLINE_MS * 1000LL;
+static constexpr uint32_t kReportTicks = CONFIG_CONTROL_REPORT_PERIOD * CONFIG_CONTROL_RATE_HZ;
+
+//angles are Q8 fixed point degrees, a tick has no floating point
+using Angle = MotionProfile::Angle;
+static constexpr Angle kOne = MotionProfile::kOne;
+
+static constexpr uint8_t kPwmResolution = 14;
+static constexpr uint32_t kPwmPeriodUs = 1000000 / CONFIG_SERVO_PWM_FREQUENCY;
+static constexpr Angle kMaxAngle = CONFIG_SERVO_MAX_ANGLE * kOne;
+
+//duty = (kDutyMin + angle * kDutyPerAngle) >> 16
+static constexpr uint32_t kDutyMax = (1 << kPwmResolution) - 1;
+static constexpr uint32_t kDutyMin = uint64_t(CONFIG_SERVO_MIN_PULSE_US) * kDutyMax * 65536 / kPwmPeriodUs;
+static constexpr uint32_t kDutyPerAngle = uint64_t(CONFIG_SERVO_MAX_PULSE_US - CONFIG_SERVO_MIN_PULSE_US) *
+                                          kDutyMax * 65536 / (uint64_t(kPwmPeriodUs) * kMaxAngle);
+
+static_assert(CONFIG_SERVO_MAX_PULSE_US < kPwmPeriodUs, "servo pulse longer than the PWM period");
+static_assert(kTickPeriodUs > 0, "control rate above 1 MHz");
+static_assert(uint64_t(kDutyMin) + uint64_t(kMaxAngle) * kDutyPerAngle + 0x8000 <= UINT32_MAX,
+              "duty does not fit 32 bit fixed point");
+
+/**
+ * @brief Setpoint of one servo over time
+ */
+struct Trajectory
+{
+    enum class Mode : uint8_t
+    {
+        Released, //no pulses
+        Hold,     //angle
+        Move,     //from -> to between start_us and end_us
+        Gesture,  //follows the gesture player
+        Pressure, //PressureController holds the gauge of finger at its target
+    };
+
+    Mode mode;
+    Angle angle; //setpoint of the last tick
+    int64_t start_us;
+    int64_t end_us;
+    uint8_t finger;
+    uint8_t gauge;
+    uint32_t duty;       //last written to LEDC
+    int64_t received_us; //command waiting for its first PWM update, 0 - none
+};
+
+static Trajectory trajectories[HandTopology::kServosCount];
+//move tables, one per servo, replanned by every move command
+static MotionProfile profiles[HandTopology::kServosCount];
+
+//one gesture plays at a time, over the servos in Gesture mode
+static GesturePlayer gesture_player;
+static int64_t gesture_start_us = 0;
+//HoldGesture carrying its own angles, played as a one keyframe gesture
+static GestureTable::Entry command_gesture;
+static GestureTable::Keyframe command_keyframe;
+
+static TaskHandle_t control_task = nullptr;
+static hw_timer_t *control_timer = nullptr;
+
+//written by the control task only
+static ControlLoop::Stats counters = {};
+static uint64_t latency_total_us = 0;
+static uint32_t latency_count = 0;
+//receipt to the first PWM update, 1 ms buckets
+static Histogram<32, 1000> latency_histogram;
+
+/**
+ * @brief LEDC duty of the pulse for an angle
+ *
+ * @param angle Angle, Q8, 0 to SERVO_MAX_ANGLE
+ * @return uint32_t Duty at kPwmResolution bits
+ */
+static uint32_t angleToDuty(Angle angle)
+{
+    return (kDutyMin + uint32_t(angle) * kDutyPerAngle + 0x8000) >> 16;
+}
+
+static constexpr int32_t toDegrees(Angle angle)
+{
+    return (angle + kOne / 2) / kOne;
+}
+
+/**
+ * @brief Start an S-curve move of a servo from its current setpoint
+ *
+ * @param servo Servo
+ * @param degrees Target angle, clamped to SERVO_MAX_ANGLE
+ * @param now_us Tick time
+ * @param end_us When the target is reached, now_us or earlier - right away
+ */
+static void moveTo(size_t servo, uint16_t degrees, int64_t now_us, int64_t end_us)
+{
+    Trajectory &trajectory = trajectories[servo];
+    int64_t duration_us = std::clamp<int64_t>(end_us - now_us, 0, UINT32_MAX);
+    profiles[servo].plan(trajectory.angle, std::min<Angle>(degrees * kOne, kMaxAngle), duration_us, kTickPeriodUs);
+    trajectory.mode = Trajectory::Mode::Move;
+    trajectory.start_us = now_us;
+    trajectory.end_us = now_us + duration_us;
+}
+
+static bool execute(const Command::ServoGoToAngle &command, int64_t received_us, int64_t now_us)
+{
+    if (command.servo >= HandTopology::kServosCount)
+    {
+        return false;
+    }
+    moveTo(command.servo, command.angle, now_us, now_us);
+    trajectories[command.servo].received_us = received_us;
+    return true;
+}
+
+static bool execute(const Command::ServoSmoothlyMove &command, int64_t received_us, int64_t now_us)
+{
+    if (command.servo >= HandTopology::kServosCount)
+    {
+        return false;
+    }
+    moveTo(command.servo, command.angle, now_us, received_us + command.duration_ms * 1000LL);
+    trajectories[command.servo].received_us = received_us;
+    return true;
+}
+
+static bool execute(const Command::HoldGesture &command, int64_t received_us, int64_t now_us)
+{
+    const GestureTable::Entry *entry;
+    const GestureTable::Keyframe *keyframes;
+    if (command.angles_count > 0)
+    {
+        //explicit angles win over the table, the first angles_count servos
+        size_t count = std::min<size_t>(command.angles_count, HandTopology::kServosCount);
+        command_gesture = {};
+        command_gesture.id = command.gesture;
+        command_gesture.keyframes = 1;
+        command_gesture.servos = (1u << count) - 1;
+        command_keyframe = {CONFIG_CONTROL_GESTURE_DURATION_MS, {}};
+        for (size_t i = 0; i < count; i++)
+        {
+            command_keyframe.angles[i] = std::min<Angle>(command.angles[i] * kOne, kMaxAngle);
+        }
+        entry = &command_gesture;
+        keyframes = &command_keyframe;
+    }
+    else
+    {
+        entry = GestureStore::find(command.gesture);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        keyframes = GestureStore::keyframes(*entry);
+    }
+    ESP_LOGD(TAG, "gesture %u %.*s", command.gesture, (int)sizeof(entry->name), entry->name);
+
+    Angle from[HandTopology::kServosCount];
+    for (size_t i = 0; i < HandTopology::kServosCount; i++)
+    {
+        from[i] = trajectories[i].angle;
+        if (entry->servos >> i & 1)
+        {
+            trajectories[i].mode = Trajectory::Mode::Gesture;
+            trajectories[i].received_us = received_us;
+        }
+        else if (trajectories[i].mode == Trajectory::Mode::Gesture)
+        {
+            //left by the previous gesture where it was
+            trajectories[i].mode = Trajectory::Mode::Hold;
+        }
+    }
+    //timed from the receipt, like the other moves
+    gesture_player.start(entry, keyframes, from);
+    gesture_start_us = received_us;
+    return true;
+}
+
+static bool execute(const Command::MoveToTargetPressure &command, int64_t received_us, int64_t now_us)
+{
+    if (command.finger >= HandTopology::kFingers ||
+        HandTopology::countOnFinger(HandTopology::SensorKind::StrainGauge, command.finger) == 0)
+    {
+        return false;
+    }
+    size_t servo = HandTopology::fingerServo(command.finger);
+    if (servo >= HandTopology::kServosCount)
+    {
+        return false;
+    }
+    Trajectory &trajectory = trajectories[servo];
+    trajectory.mode = Trajectory::Mode::Pressure;
+    trajectory.finger = command.finger;
+    trajectory.gauge = HandTopology::first(HandTopology::SensorKind::StrainGauge, command.finger);
+    trajectory.received_us = received_us;
+    PressureController::engage(command.finger, command.pressure, trajectory.angle);
+    return true;
+}
+
+static bool execute(const Command::ServoLock &command, int64_t received_us, int64_t now_us)
+{
+    if (command.servo >= HandTopology::kServosCount)
+    {
+        return false;
+    }
+    //holds where the servo is due now: a move or gesture of the same drain
+    //has not been evaluated by a tick yet
+    Trajectory &trajectory = trajectories[command.servo];
+    if (trajectory.mode == Trajectory::Mode::Move)
+    {
+        trajectory.angle = profiles[command.servo].at(std::max<int64_t>(now_us - trajectory.start_us, 0));
+    }
+    else if (trajectory.mode == Trajectory::Mode::Gesture)
+    {
+        Angle pose[HandTopology::kServosCount];
+        gesture_player.at(std::clamp<int64_t>(now_us - gesture_start_us, 0, UINT32_MAX), pose);
+        trajectory.angle = pose[command.servo];
+    }
+    trajectory.mode = Trajectory::Mode::Hold;
+    trajectory.received_us = received_us;
+    return true;
+}
+
+static bool execute(const Command::ServoUnLock &command, int64_t received_us, int64_t now_us)
+{
+    if (command.servo >= HandTopology::kServosCount)
+    {
+        return false;
+    }
+    trajectories[command.servo].mode = Trajectory::Mode::Released;
+    trajectories[command.servo].received_us = received_us;
+    return true;
+}
+
+/**
+ * @brief Turn queued commands into trajectories, stale ones are dropped
+ *
+ * Commands superseded by a newer one of the same batch are coalesced by
+ * the queue and never reach here.
+ *
+ * @param now_us Tick time
+ */
+static void drainCommands(int64_t now_us)
+{
+    static CommandsQueue::QueuedCommand batch[CONFIG_COMMANDS_QUEUE_CAPACITY];
+    size_t count = CommandsQueue::drain(batch, std::size(batch));
+    for (size_t i = 0; i < count; i++)
+    {
+        const CommandsQueue::QueuedCommand &queued = batch[i];
+        if (now_us - queued.received_us > kDeadlineUs)
+        {
+            counters.expired++;
+            continue;
+        }
+        bool valid = std::visit([&](const auto &command)
+                                { return execute(command, queued.received_us, now_us); },
+                                queued.command);
+        if (valid)
+        {
+            counters.commands++;
+        }
+        else
+        {
+            counters.rejected++;
+            ESP_LOGW(TAG, "command for a servo or finger the hand does not have");
+        }
+    }
+}
+
+/**
+ * @brief One control period: commands, setpoints, PWM, HandState
+ *
+ * @param now_us Tick time
+ */
+static void tick(int64_t now_us)
+{
+    drainCommands(now_us);
+
+    static uint16_t pressures[HandLayout::kStrainGauges] = {};
+    bool pressure_active = std::any_of(std::begin(trajectories), std::end(trajectories), [](const Trajectory &trajectory)
+                                       { return trajectory.mode == Trajectory::Mode::Pressure; });
+#ifdef CONFIG_SENSORS_ACQUISITION
+    //newest sweep of the acquisition, without one the gauges of the last
+    static SensorAcquisition::Sweep sweep;
+    bool sampled = SensorAcquisition::latest(sweep);
+    if (sampled)
+    {
+        memcpy(pressures, sweep.straingauges, sizeof(pressures));
+    }
+    //a tick without a new sweep would step the loops on the readings of the last
+    bool gauges_fresh = sampled;
+#else
+    //pressure loops sample the gauges once per tick, straight from the ADC
+    bool sampled = false;
+    if (pressure_active)
+    {
+        PressureController::acquire(pressures);
+    }
+    bool gauges_fresh = pressure_active;
+#endif
+
+    //one pose for every servo following the gesture
+    static Angle pose[HandTopology::kServosCount];
+    bool gesture_playing = false;
+    if (std::any_of(std::begin(trajectories), std::end(trajectories), [](const Trajectory &trajectory)
+                    { return trajectory.mode == Trajectory::Mode::Gesture; }))
+    {
+        gesture_playing = gesture_player.at(std::clamp<int64_t>(now_us - gesture_start_us, 0, UINT32_MAX), pose);
+    }
+
+    bool moved = false;
+    int64_t recorded_us = 0;
+    for (size_t i = 0; i < HandTopology::kServosCount; i++)
+    {
+        Trajectory &trajectory = trajectories[i];
+        Angle previous = trajectory.angle;
+        switch (trajectory.mode)
+        {
+        case Trajectory::Mode::Move:
+            //a table lookup, the profile was planned by the command
+            trajectory.angle = profiles[i].at(std::max<int64_t>(now_us - trajectory.start_us, 0));
+            if (now_us >= trajectory.end_us)
+            {
+                trajectory.mode = Trajectory::Mode::Hold;
+            }
+            break;
+        case Trajectory::Mode::Gesture:
+            trajectory.angle = pose[i];
+            if (!gesture_playing)
+            {
+                trajectory.mode = Trajectory::Mode::Hold;
+            }
+            break;
+        case Trajectory::Mode::Pressure:
+            if (gauges_fresh)
+            {
+                trajectory.angle = PressureController::step(trajectory.finger, pressures[trajectory.gauge], trajectory.angle);
+            }
+            break;
+        case Trajectory::Mode::Hold:
+        case Trajectory::Mode::Released:
+            break;
+        }
+
+        uint32_t duty = trajectory.mode == Trajectory::Mode::Released ? 0 : angleToDuty(trajectory.angle);
+        bool written = duty != trajectory.duty;
+        if (written)
+        {
+            ledcWrite(HandTopology::kServos[i].pwm_pin, duty);
+            trajectory.duty = duty;
+        }
+        //a gesture moves several servos, its latency is recorded once
+        if (written && trajectory.received_us != 0 && trajectory.received_us != recorded_us)
+        {
+            recorded_us = trajectory.received_us;
+            uint32_t latency = esp_timer_get_time() - trajectory.received_us;
+            latency_histogram.record(latency);
+            latency_total_us += latency;
+            latency_count++;
+            counters.latency_us_max = std::max(counters.latency_us_max, latency);
+        }
+        //a command waits for the first PWM update it causes, one that causes
+        //none (holding, or no change until the deadline) is not a sample
+        if (written || trajectory.received_us == recorded_us || trajectory.mode == Trajectory::Mode::Hold ||
+            trajectory.mode == Trajectory::Mode::Released || now_us - trajectory.received_us > kDeadlineUs)
+        {
+            trajectory.received_us = 0;
+        }
+        moved |= toDegrees(previous) != toDegrees(trajectory.angle);
+    }
+
+    bool gauges = pressure_active || sampled;
+    if (moved || gauges)
+    {
+        HandState::update([gauges, sampled](HandSnapshot &state)
+                          {
+                              for (size_t i = 0; i < HandLayout::kServos; i++)
+                              {
+                                  state.servo_angle[i] = toDegrees(trajectories[i].angle);
+                              }
+                              if (gauges)
+                              {
+                                  memcpy(state.straingauge_pressure, pressures, sizeof(pressures));
+                              }
+#ifdef CONFIG_SENSORS_ACQUISITION
+                              if (sampled)
+                              {
+                                  for (size_t i = 0; i < HandLayout::kPotentiometers; i++)
+                                  {
+                                      state.potentiometer_angle[i] = SensorAcquisition::degrees(sweep.potentiometers[i]);
+                                  }
+                              }
+#endif
+                          });
+    }
+}
+
+/**
+ * @brief Hardware timer alarm, wakes the control task
+ */
+static void ARDUINO_ISR_ATTR onTimer()
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(control_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief Control task, one tick per timer alarm
+ *
+ * @param pvParameters Unused
+ */
+static void controlTask(void *pvParameters)
+{
+    for (;;)
+    {
+        uint32_t alarms = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (alarms == 0)
+        {
+            continue;
+        }
+        //more than one alarm: the last tick ran into the next period
+        counters.overruns += alarms - 1;
+        counters.ticks++;
+        tick(esp_timer_get_time());
+
+        if (kReportTicks != 0 && counters.ticks % kReportTicks == 0)
+        {
+            ESP_LOGI(TAG, "ticks %lu, overruns %lu, commands %lu, coalesced %lu, expired %lu, rejected %lu, queue dropped %lu",
+                     (unsigned long)counters.ticks, (unsigned long)counters.overruns,
+                     (unsigned long)counters.commands, (unsigned long)CommandsQueue::coalesced(),
+                     (unsigned long)counters.expired, (unsigned long)counters.rejected,
+                     (unsigned long)CommandsQueue::stats().dropped);
+            auto pressure = PressureController::stats();
+            ESP_LOGI(TAG, "pressure steps %lu, saturated %lu, gauge sweeps %lu, max %lu us",
+                     (unsigned long)pressure.steps, (unsigned long)pressure.saturated,
+                     (unsigned long)pressure.acquisitions, (unsigned long)pressure.acquisition_us_max);
+            latency_histogram.log(TAG, "command to pwm us");
+            latency_histogram.reset();
+        }
+    }
+}
+
+void ControlLoop::init()
+{
+#ifndef CONFIG_SENSORS_ACQUISITION
+    //the acquisition owns the multiplexers and the ADC otherwise
+    PressureController::init();
+#endif
+    GestureStore::load(CONFIG_GESTURES_PARTITION);
+    for (size_t i = 0; i < HandTopology::kServosCount; i++)
+    {
+        if (!ledcAttach(HandTopology::kServos[i].pwm_pin, CONFIG_SERVO_PWM_FREQUENCY, kPwmResolution))
+        {
+            ESP_LOGE(TAG, "servo %u: pwm pin %u not attached", (unsigned)i, HandTopology::kServos[i].pwm_pin);
+        }
+        //position unknown until the first command, moves start from the middle
+        trajectories[i] = {};
+        trajectories[i].angle = kMaxAngle / 2;
+    }
+
+    xTaskCreatePinnedToCore(controlTask, "ControlTask", 4096, nullptr, 10, &control_task, CONFIG_CONTROL_CORE);
+
+    control_timer = timerBegin(kTimerFrequency);
+    if (control_timer == nullptr)
+    {
+        ESP_LOGE(TAG, "no hardware timer, the control loop does not run");
+        return;
+    }
+    timerAttachInterrupt(control_timer, onTimer);
+    timerAlarm(control_timer, kTickPeriodUs, true, 0);
+}
+
+ControlLoop::Stats ControlLoop::stats()
+{
+    Stats stats = counters;
+    stats.coalesced = CommandsQueue::coalesced();
+    stats.latency_us_mean = latency_count ? latency_total_us / latency_count : 0;
+    return stats;
+}
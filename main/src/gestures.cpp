@@ -0,0 +1,329 @@
+#include "gestures.hpp"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+static const char *TAG = "GESTURES";
+
+using GestureTable::Entry;
+using GestureTable::Header;
+using GestureTable::Keyframe;
+using Angle = GesturePlayer::Angle;
+
+static constexpr Angle kMaxAngle = CONFIG_SERVO_MAX_ANGLE * MotionProfile::kOne;
+
+/*
+built-in table, written for the servo order of hand_topology.hpp:
+thumb, index, middle, ring, little, thumb rotation. 0 - open, SERVO_MAX_ANGLE - closed
+*/
+static_assert(HandTopology::kServosCount == 6, "built-in gestures are written for six servos");
+
+static constexpr Keyframe pose(uint16_t time_ms, int thumb, int index, int middle, int ring, int little, int rotation)
+{
+    const int degrees[] = {thumb, index, middle, ring, little, rotation};
+    Keyframe keyframe = {time_ms, {}};
+    for (size_t i = 0; i < std::size(degrees); i++)
+    {
+        keyframe.angles[i] = std::min(degrees[i], CONFIG_SERVO_MAX_ANGLE) * MotionProfile::kOne;
+    }
+    return keyframe;
+}
+
+static constexpr Keyframe kKeyframes[] = {
+    //open
+    pose(500, 0, 0, 0, 0, 0, 0),
+    //fist
+    pose(500, 170, 180, 180, 180, 180, 90),
+    //point
+    pose(500, 170, 0, 180, 180, 180, 90),
+    //pinch: thumb across first, then both close
+    pose(300, 60, 0, 0, 0, 0, 120),
+    pose(600, 120, 110, 0, 0, 0, 120),
+    //wave: fingers flex one after another
+    pose(200, 0, 0, 0, 0, 0, 0),
+    pose(400, 0, 90, 0, 0, 0, 0),
+    pose(600, 0, 0, 90, 0, 0, 0),
+    pose(800, 0, 0, 0, 90, 0, 0),
+    pose(1000, 0, 0, 0, 0, 90, 0),
+    pose(1200, 0, 0, 0, 0, 0, 0),
+    //thumbs up
+    pose(500, 0, 180, 180, 180, 180, 0),
+};
+
+struct Definition
+{
+    const char *name;
+    uint8_t id;
+    uint8_t first;
+    uint8_t keyframes;
+};
+
+static constexpr Definition kDefinitions[] = {
+    {"open", 0, 0, 1},
+    {"fist", 1, 1, 1},
+    {"point", 2, 2, 1},
+    {"pinch", 3, 3, 2},
+    {"wave", 4, 5, 6},
+    {"thumbs-up", 5, 11, 1},
+};
+
+//header, entries and keyframes back to back, the layout of an image
+struct BuiltIn
+{
+    Header header;
+    Entry entries[std::size(kDefinitions)];
+    Keyframe keyframes[std::size(kKeyframes)];
+};
+
+static constexpr size_t kBuiltInSize = offsetof(BuiltIn, keyframes) + sizeof(kKeyframes);
+
+static constexpr BuiltIn build()
+{
+    BuiltIn image = {};
+    //crc is filled in by the first use, it needs the bytes
+    image.header = {GestureTable::kMagic, GestureTable::kVersion, uint8_t(HandTopology::kServosCount),
+                    uint8_t(std::size(kDefinitions)), uint32_t(kBuiltInSize), 0};
+    for (size_t i = 0; i < std::size(kDefinitions); i++)
+    {
+        const Definition &definition = kDefinitions[i];
+        Entry &entry = image.entries[i];
+        for (size_t c = 0; c < GestureTable::kNameSize - 1 && definition.name[c] != 0; c++)
+        {
+            entry.name[c] = definition.name[c];
+        }
+        entry.id = definition.id;
+        entry.keyframes = definition.keyframes;
+        entry.servos = (1u << HandTopology::kServosCount) - 1;
+        entry.offset = offsetof(BuiltIn, keyframes) + definition.first * sizeof(Keyframe);
+    }
+    for (size_t i = 0; i < std::size(kKeyframes); i++)
+    {
+        image.keyframes[i] = kKeyframes[i];
+    }
+    return image;
+}
+
+static constexpr bool builtInValid()
+{
+    for (size_t i = 0; i < std::size(kDefinitions); i++)
+    {
+        const Definition &definition = kDefinitions[i];
+        if (definition.keyframes == 0 || definition.first + definition.keyframes > std::size(kKeyframes))
+        {
+            return false;
+        }
+        for (size_t k = definition.first + 1; k < size_t(definition.first + definition.keyframes); k++)
+        {
+            if (kKeyframes[k].time_ms <= kKeyframes[k - 1].time_ms)
+            {
+                return false;
+            }
+        }
+        for (size_t j = i + 1; j < std::size(kDefinitions); j++)
+        {
+            if (kDefinitions[j].id == definition.id)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static_assert(builtInValid(), "built-in gestures: keyframes out of range, times not increasing or ids shared");
+static_assert(std::size(kDefinitions) <= 255 && kBuiltInSize <= CONFIG_GESTURES_MAX_TABLE_SIZE);
+
+static BuiltIn built_in = build();
+
+//image loaded from the partition
+alignas(4) static uint8_t loaded[CONFIG_GESTURES_MAX_TABLE_SIZE];
+
+//table in use, the built-in one until a partition image is loaded
+static const uint8_t *table = reinterpret_cast<const uint8_t *>(&built_in);
+
+static const Header &header()
+{
+    return *reinterpret_cast<const Header *>(table);
+}
+
+uint32_t GestureTable::crc(const uint8_t *image, size_t size)
+{
+    return size < sizeof(Header) ? 0 : esp_rom_crc32_le(0, image + sizeof(Header), size - sizeof(Header));
+}
+
+bool GestureTable::valid(const uint8_t *image, size_t size)
+{
+    if (size < sizeof(Header))
+    {
+        return false;
+    }
+    const Header &header = *reinterpret_cast<const Header *>(image);
+    if (header.magic != kMagic || header.version != kVersion || header.servos != HandTopology::kServosCount ||
+        header.size != size || sizeof(Header) + header.count * sizeof(Entry) > size ||
+        header.crc != crc(image, size))
+    {
+        return false;
+    }
+    auto entries = reinterpret_cast<const Entry *>(image + sizeof(Header));
+    for (size_t i = 0; i < header.count; i++)
+    {
+        const Entry &entry = entries[i];
+        if (entry.keyframes == 0 || entry.offset % alignof(Keyframe) != 0 || entry.offset < sizeof(Header) ||
+            entry.offset + entry.keyframes * sizeof(Keyframe) > size ||
+            (entry.servos >> HandTopology::kServosCount) != 0)
+        {
+            return false;
+        }
+        auto keyframes = reinterpret_cast<const Keyframe *>(image + entry.offset);
+        for (size_t k = 0; k < entry.keyframes; k++)
+        {
+            if ((k > 0 && keyframes[k].time_ms <= keyframes[k - 1].time_ms) ||
+                std::any_of(std::begin(keyframes[k].angles), std::end(keyframes[k].angles),
+                            [](uint16_t angle)
+                            { return angle > kMaxAngle; }))
+            {
+                return false;
+            }
+        }
+        for (size_t j = i + 1; j < header.count; j++)
+        {
+            if (entries[j].id == entry.id)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+esp_err_t GestureStore::load(const char *label)
+{
+    built_in.header.crc = GestureTable::crc(reinterpret_cast<const uint8_t *>(&built_in), kBuiltInSize);
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr)
+    {
+        ESP_LOGW(TAG, "no partition %s, %u built-in gestures", label, (unsigned)count());
+        return ESP_ERR_NOT_FOUND;
+    }
+    Header image = {};
+    esp_err_t err = esp_partition_read(partition, 0, &image, sizeof(image));
+    if (err != ESP_OK || image.magic != GestureTable::kMagic)
+    {
+        ESP_LOGI(TAG, "partition %s empty, %u built-in gestures", label, (unsigned)count());
+        return err == ESP_OK ? ESP_ERR_INVALID_STATE : err;
+    }
+    if (image.size > sizeof(loaded) || image.size > partition->size)
+    {
+        ESP_LOGE(TAG, "table of %lu bytes, room for %u", (unsigned long)image.size, (unsigned)sizeof(loaded));
+        return ESP_ERR_INVALID_SIZE;
+    }
+    err = esp_partition_read(partition, 0, loaded, image.size);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (!GestureTable::valid(loaded, image.size))
+    {
+        ESP_LOGE(TAG, "partition %s: invalid table, %u built-in gestures", label, (unsigned)count());
+        return ESP_ERR_INVALID_STATE;
+    }
+    table = loaded;
+    ESP_LOGI(TAG, "%u gestures, %lu bytes", (unsigned)count(), (unsigned long)image.size);
+    return ESP_OK;
+}
+
+const Entry *GestureStore::entries()
+{
+    return reinterpret_cast<const Entry *>(table + sizeof(Header));
+}
+
+size_t GestureStore::count()
+{
+    return header().count;
+}
+
+size_t GestureStore::size()
+{
+    return header().size;
+}
+
+bool GestureStore::builtIn()
+{
+    return table != loaded;
+}
+
+const Entry *GestureStore::find(uint8_t id)
+{
+    const Entry *first = entries();
+    const Entry *last = first + count();
+    const Entry *entry = std::find_if(first, last, [id](const Entry &entry)
+                                      { return entry.id == id; });
+    return entry == last ? nullptr : entry;
+}
+
+const Keyframe *GestureStore::keyframes(const Entry &entry)
+{
+    return reinterpret_cast<const Keyframe *>(table + entry.offset);
+}
+
+//MotionProfile::shape, Q16, 64 segments
+static const auto kEase = []()
+{
+    std::array<uint16_t, 65> ease = {};
+    for (size_t i = 0; i < ease.size(); i++)
+    {
+        ease[i] = std::lround(MotionProfile::shape(float(i) / 64) * 65535);
+    }
+    return ease;
+}();
+
+void GesturePlayer::start(const Entry *entry, const Keyframe *keyframes, const Angle *from)
+{
+    this->entry = entry;
+    this->keyframes = keyframes;
+    segment = 0;
+    std::copy(from, from + HandTopology::kServosCount, this->from);
+}
+
+bool GesturePlayer::at(uint32_t elapsed_us, Angle *pose)
+{
+    if (entry == nullptr)
+    {
+        return false;
+    }
+    while (segment < entry->keyframes && elapsed_us >= keyframes[segment].time_ms * 1000u)
+    {
+        segment++;
+    }
+    bool playing = segment < entry->keyframes;
+    const Keyframe &target = keyframes[playing ? segment : entry->keyframes - 1];
+    uint32_t begin_us = segment == 0 ? 0 : keyframes[segment - 1].time_ms * 1000u;
+
+    //eased fraction of the segment, Q12
+    int32_t ease = 1 << 12;
+    if (playing)
+    {
+        uint32_t u = (uint64_t(elapsed_us - begin_us) << 16) / (target.time_ms * 1000u - begin_us); //Q16
+        uint32_t idx = u >> 10;
+        int32_t a = kEase[idx];
+        int32_t b = kEase[idx + 1];
+        ease = (a + (((b - a) * int32_t(u & 1023)) >> 10)) >> 4;
+    }
+    for (size_t i = 0; i < HandTopology::kServosCount; i++)
+    {
+        if (entry->servos >> i & 1)
+        {
+            Angle begin = segment == 0 ? from[i] : keyframes[segment - 1].angles[i];
+            pose[i] = begin + (((Angle(target.angles[i]) - begin) * ease) >> 12);
+        }
+    }
+    return playing;
+}
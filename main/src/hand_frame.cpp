@@ -0,0 +1,238 @@
+#include "hand_frame.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::ArrayOutputStream;
+using google::protobuf::io::CodedOutputStream;
+
+/**
+ * @brief Encoded size of one value of a packed field
+ */
+static size_t valueSize(float value)
+{
+    return sizeof(float);
+}
+
+static size_t valueSize(int16_t value)
+{
+    return WireFormatLite::SInt32Size(value);
+}
+
+static size_t valueSize(uint16_t value)
+{
+    return CodedOutputStream::VarintSize32(value);
+}
+
+static void writeValue(CodedOutputStream &out, float value)
+{
+    out.WriteLittleEndian32(WireFormatLite::EncodeFloat(value));
+}
+
+static void writeValue(CodedOutputStream &out, int16_t value)
+{
+    out.WriteVarint32(WireFormatLite::ZigZagEncode32(value));
+}
+
+static void writeValue(CodedOutputStream &out, uint16_t value)
+{
+    out.WriteVarint32(value);
+}
+
+/**
+ * @brief Write a packed repeated field, empty fields are omitted
+ *
+ * @param value callable returning the k-th value
+ */
+template <typename Get>
+static void writePacked(CodedOutputStream &out, uint32_t field, size_t count, Get &&value)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    size_t size = 0;
+    for (size_t k = 0; k < count; k++)
+    {
+        size += valueSize(value(k));
+    }
+    out.WriteTag(WireFormatLite::MakeTag(field, WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    out.WriteVarint32(size);
+    for (size_t k = 0; k < count; k++)
+    {
+        writeValue(out, value(k));
+    }
+}
+
+static void writeVarint(CodedOutputStream &out, uint32_t field, uint64_t value)
+{
+    out.WriteTag(WireFormatLite::MakeTag(field, WireFormatLite::WIRETYPE_VARINT));
+    out.WriteVarint64(value);
+}
+
+static constexpr size_t kMaxChannels = std::max({
+    HandLayout::kAxes * HandLayout::kImus,
+    HandLayout::kAxes * HandLayout::kProcessedImus,
+    HandLayout::kPotentiometers,
+    HandLayout::kStrainGauges,
+    HandLayout::kServos,
+});
+
+/**
+ * @brief Call f for every channel kind of the frame
+ *
+ * f(field, channels count, deadband, accessor), accessor returns the first
+ * channel of the kind in a (const or mutable) snapshot
+ */
+template <typename F>
+static void forEachKind(const HandFrame::Deadband &deadband, F &&f)
+{
+    using namespace HandFrame;
+    using namespace HandLayout;
+
+    f(ImuAccel, kAxes * kImus, deadband.imu,
+      [](auto &snapshot) { return &snapshot.imu_accel[0][0]; });
+    f(ImuGyro, kAxes * kImus, deadband.imu,
+      [](auto &snapshot) { return &snapshot.imu_gyro[0][0]; });
+    f(ProcessedImuOrientation, kAxes * kProcessedImus, deadband.imu,
+      [](auto &snapshot) { return &snapshot.processed_imu_orientation[0][0]; });
+    f(PotentiometerAngle, kPotentiometers, deadband.potentiometer,
+      [](auto &snapshot) { return snapshot.potentiometer_angle; });
+    f(StrainGaugePressure, kStrainGauges, deadband.straingauge,
+      [](auto &snapshot) { return snapshot.straingauge_pressure; });
+    f(ServoAngle, kServos, deadband.servo,
+      [](auto &snapshot) { return snapshot.servo_angle; });
+}
+
+/**
+ * @brief Encode a frame
+ *
+ * Without a baseline every channel of every sample is written. With a
+ * baseline (one sample only) only channels that moved more than their
+ * deadband are written, preceded by their indexes, and the baseline is
+ * updated with them.
+ *
+ * @param changed Number of channels written
+ * @return size_t Encoded size, 0 if the buffer is too small
+ */
+static size_t encodeFrame(const HandSnapshot *samples, size_t samples_count, uint32_t sample_period_us,
+                          uint32_t sequence, HandSnapshot *baseline, const HandFrame::Deadband &deadband,
+                          uint8_t *buffer, size_t size, size_t &changed)
+{
+    using namespace HandFrame;
+
+    ArrayOutputStream stream(buffer, size);
+    size_t written;
+    bool failed;
+    {
+        CodedOutputStream out(&stream);
+        writeVarint(out, TimestampUs, samples[0].timestamp_us);
+        writeVarint(out, Sequence, sequence);
+        if (baseline == nullptr)
+        {
+            writeVarint(out, Keyframe, 1);
+        }
+        if (samples_count > 1)
+        {
+            writeVarint(out, Samples, samples_count);
+            writeVarint(out, SamplePeriodUs, sample_period_us);
+        }
+
+        changed = 0;
+        forEachKind(deadband, [&](uint32_t field, size_t count, float band, auto channels)
+        {
+            if (baseline == nullptr)
+            {
+                writePacked(out, field, count * samples_count,
+                            [&](size_t k) { return channels(samples[k / count])[k % count]; });
+                changed += count;
+                return;
+            }
+
+            auto *values = channels(samples[0]);
+            auto *sent = channels(*baseline);
+            uint8_t indexes[kMaxChannels];
+            size_t n = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (std::fabs(float(values[i]) - float(sent[i])) > band)
+                {
+                    indexes[n++] = i;
+                    sent[i] = values[i];
+                }
+            }
+            writePacked(out, field + IndexOffset, n, [&](size_t k) { return uint16_t(indexes[k]); });
+            writePacked(out, field, n, [&](size_t k) { return values[indexes[k]]; });
+            changed += n;
+        });
+
+        out.Trim();
+        written = out.ByteCount();
+        failed = out.HadError();
+    }
+    return failed ? 0 : written;
+}
+
+size_t HandFrame::encode(const HandSnapshot &snapshot, uint32_t sequence, uint8_t *buffer, size_t size)
+{
+    size_t changed;
+    return encodeFrame(&snapshot, 1, 0, sequence, nullptr, {}, buffer, size, changed);
+}
+
+size_t HandFrame::encodeSamples(const HandSnapshot *samples, size_t count, uint32_t sample_period_us,
+                                uint32_t sequence, uint8_t *buffer, size_t size)
+{
+    size_t changed;
+    return encodeFrame(samples, count, sample_period_us, sequence, nullptr, {}, buffer, size, changed);
+}
+
+size_t HandFrame::DeltaEncoder::encode(const HandSnapshot &snapshot, uint8_t *buffer, size_t size)
+{
+    pending_keyframe = keyframe_needed ||
+                       (keyframe_interval != 0 && since_keyframe + 1 >= keyframe_interval);
+
+    size_t changed;
+    size_t written;
+    if (pending_keyframe)
+    {
+        pending = snapshot;
+        written = encodeFrame(&snapshot, 1, 0, sequence, nullptr, deadband, buffer, size, changed);
+    }
+    else
+    {
+        pending = baseline;
+        written = encodeFrame(&snapshot, 1, 0, sequence, &pending, deadband, buffer, size, changed);
+        if (changed == 0)
+        {
+            //idle hand, nothing to send
+            since_keyframe++;
+            return 0;
+        }
+    }
+    return written;
+}
+
+void HandFrame::DeltaEncoder::commit(bool accepted)
+{
+    if (!accepted)
+    {
+        keyframe_needed = true;
+        return;
+    }
+    baseline = pending;
+    sequence++;
+    if (pending_keyframe)
+    {
+        keyframe_needed = false;
+        since_keyframe = 0;
+    }
+    else
+    {
+        since_keyframe++;
+    }
+}
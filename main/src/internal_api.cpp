@@ -1,11 +1,233 @@
 #include "internal_api.hpp"
+#include "gestures.hpp"
 
-SmallMutex HandState::mutex = SmallMutex();
+#include <algorithm>
+#include <iterator>
 
-std::vector<Imu::IMU> HandState::imus = {};
-std::vector<Imu::ResultIMU> HandState::processed_imus = {};
-std::vector<Potentiometer::Potentiometer> HandState::potentiometers = {};
-std::vector<Straingauge::StrainGuage> HandState::straingauges = {};
-std::vector<Servo::Servo> HandState::servos = {};
+SnapshotBuffer<HandSnapshot, HandState::kMaxReaders> HandState::state;
 
-std::queue<CommandsQueue::CommandType> CommandsQueue::Queue::queue = {};
\ No newline at end of file
+void toMessage(const HandSnapshot &snapshot, int idx, Imu::IMU &message)
+{
+    message.set_id(idx);
+    message.set_ax(snapshot.imu_accel[HandLayout::X][idx]);
+    message.set_ay(snapshot.imu_accel[HandLayout::Y][idx]);
+    message.set_az(snapshot.imu_accel[HandLayout::Z][idx]);
+    message.set_gx(snapshot.imu_gyro[HandLayout::X][idx]);
+    message.set_gy(snapshot.imu_gyro[HandLayout::Y][idx]);
+    message.set_gz(snapshot.imu_gyro[HandLayout::Z][idx]);
+}
+
+void toMessage(const HandSnapshot &snapshot, int idx, Imu::ResultIMU &message)
+{
+    message.set_roll(snapshot.processed_imu_orientation[HandLayout::Roll][idx]);
+    message.set_pitch(snapshot.processed_imu_orientation[HandLayout::Pitch][idx]);
+    message.set_yaw(snapshot.processed_imu_orientation[HandLayout::Yaw][idx]);
+}
+
+/**
+ * @brief Position reported for every joint, indexed by HandTopology::Sensor::joint
+ *
+ * Potentiometer::Position names three joints only. The thumb has five and
+ * the fingers four, the joints past p2 are reported as p2. The telemetry
+ * order, finger by finger and joint by joint, still tells them apart.
+ */
+static constexpr Potentiometer::Position kJointPositions[] = {
+    Potentiometer::Position::p0,
+    Potentiometer::Position::p1,
+    Potentiometer::Position::p2,
+    Potentiometer::Position::p2,
+    Potentiometer::Position::p2,
+};
+
+static constexpr bool jointPositionsValid()
+{
+    for (auto position : kJointPositions)
+    {
+        if (position < Potentiometer::Position_MIN || position > Potentiometer::Position_MAX)
+        {
+            return false;
+        }
+    }
+    for (auto &sensor : HandTopology::kSensors)
+    {
+        if (sensor.kind == HandTopology::SensorKind::Potentiometer && sensor.joint >= std::size(kJointPositions))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(jointPositionsValid(), "every potentiometer joint must map to a Potentiometer::Position");
+
+void toMessage(const HandSnapshot &snapshot, int idx, Potentiometer::Potentiometer &message)
+{
+    auto &sensor = HandTopology::sensor(HandTopology::SensorKind::Potentiometer, idx);
+    message.set_finger(static_cast<Shared::Finger>(sensor.finger));
+    message.set_positoin(kJointPositions[sensor.joint]);
+    message.set_angle(snapshot.potentiometer_angle[idx]);
+}
+
+void toMessage(const HandSnapshot &snapshot, int idx, Straingauge::StrainGuage &message)
+{
+    auto &sensor = HandTopology::sensor(HandTopology::SensorKind::StrainGauge, idx);
+    message.set_finger(static_cast<Shared::Finger>(sensor.finger));
+    message.set_pressure(snapshot.straingauge_pressure[idx]);
+}
+
+void toMessage(const HandSnapshot &snapshot, int idx, Servo::Servo &message)
+{
+    message.set_finger(static_cast<Shared::Finger>(HandTopology::kServos[idx].finger));
+    message.set_angle(snapshot.servo_angle[idx]);
+}
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Imu::IMU &message)
+{
+    snapshot.imu_accel[HandLayout::X][idx] = message.ax();
+    snapshot.imu_accel[HandLayout::Y][idx] = message.ay();
+    snapshot.imu_accel[HandLayout::Z][idx] = message.az();
+    snapshot.imu_gyro[HandLayout::X][idx] = message.gx();
+    snapshot.imu_gyro[HandLayout::Y][idx] = message.gy();
+    snapshot.imu_gyro[HandLayout::Z][idx] = message.gz();
+}
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Imu::ResultIMU &message)
+{
+    snapshot.processed_imu_orientation[HandLayout::Roll][idx] = message.roll();
+    snapshot.processed_imu_orientation[HandLayout::Pitch][idx] = message.pitch();
+    snapshot.processed_imu_orientation[HandLayout::Yaw][idx] = message.yaw();
+}
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Potentiometer::Potentiometer &message)
+{
+    snapshot.potentiometer_angle[idx] = message.angle();
+}
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Straingauge::StrainGuage &message)
+{
+    snapshot.straingauge_pressure[idx] = message.pressure();
+}
+
+void fromMessage(HandSnapshot &snapshot, int idx, const Servo::Servo &message)
+{
+    snapshot.servo_angle[idx] = message.angle();
+}
+
+SpscRing<CommandsQueue::QueuedCommand, CONFIG_COMMANDS_QUEUE_CAPACITY, OverflowPolicy::DropNewest> 
+    CommandsQueue::Queue::queue;
+std::atomic<uint32_t> CommandsQueue::Queue::coalesced_{0};
+
+static_assert(HandTopology::kServosCount <= 32 && HandTopology::kFingers <= 32,
+              "coalescing keeps servos and fingers in 32 bit masks");
+
+/**
+ * @brief Servos and fingers the newer commands of a batch already decide
+ */
+struct Superseded
+{
+    uint32_t servos = 0;  //newer move or gesture
+    uint32_t fingers = 0; //newer pressure target
+
+    static constexpr uint32_t bit(size_t idx)
+    {
+        return idx < 32 ? 1u << idx : 0;
+    }
+
+    //every check marks the target, an out of range index is never superseded
+    //and is left for the control loop to reject
+    bool servo(uint8_t servo)
+    {
+        if (servo >= HandTopology::kServosCount)
+        {
+            return false;
+        }
+        bool result = servos & bit(servo);
+        servos |= bit(servo);
+        return result;
+    }
+
+    bool operator()(const Command::ServoGoToAngle &command)
+    {
+        return servo(command.servo);
+    }
+
+    bool operator()(const Command::ServoSmoothlyMove &command)
+    {
+        return servo(command.servo);
+    }
+
+    bool operator()(const Command::HoldGesture &command)
+    {
+        uint32_t covered = 0;
+        for (uint8_t i = 0; i < command.angles_count && i < HandTopology::kServosCount; i++)
+        {
+            covered |= bit(i);
+        }
+        if (command.angles_count == 0)
+        {
+            //a gesture of the table, the table is read only after boot
+            const GestureTable::Entry *entry = GestureStore::find(command.gesture);
+            covered = entry ? entry->servos : 0;
+        }
+        if (covered == 0)
+        {
+            //moves nothing or unknown, left for the control loop to reject
+            return false;
+        }
+        bool result = (servos & covered) == covered;
+        servos |= covered;
+        return result;
+    }
+
+    bool operator()(const Command::MoveToTargetPressure &command)
+    {
+        if (command.finger >= HandTopology::kFingers)
+        {
+            return false;
+        }
+        bool result = (fingers & bit(command.finger)) ||
+                      (servos & bit(HandTopology::fingerServo(command.finger)));
+        fingers |= bit(command.finger);
+        return result;
+    }
+
+    bool operator()(const Command::ServoLock &)
+    {
+        return false;
+    }
+
+    bool operator()(const Command::ServoUnLock &)
+    {
+        return false;
+    }
+};
+
+size_t CommandsQueue::Queue::drain(QueuedCommand *batch, size_t capacity)
+{
+    size_t count = 0;
+    capacity = std::min<size_t>(capacity, CONFIG_COMMANDS_QUEUE_CAPACITY);
+    while (count < capacity && queue.pop(batch[count]))
+    {
+        count++;
+    }
+#ifdef CONFIG_COMMANDS_COALESCE
+    //newest first, a command is dropped if a newer one decides its target
+    bool keep[CONFIG_COMMANDS_QUEUE_CAPACITY];
+    Superseded superseded;
+    for (size_t i = count; i-- > 0;)
+    {
+        keep[i] = !std::visit(superseded, batch[i].command);
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keep[i])
+        {
+            batch[kept++] = batch[i];
+        }
+    }
+    coalesced_.fetch_add(count - kept, std::memory_order_relaxed);
+    count = kept;
+#endif
+    return count;
+}
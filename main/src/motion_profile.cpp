@@ -0,0 +1,84 @@
+#include "motion_profile.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//phase lengths, fractions of the move: jerk, constant acceleration, cruise
+static constexpr float kJerk = 1.0f / 8;
+static constexpr float kAccel = 1.0f / 8;
+static constexpr float kCruise = 1 - 4 * kJerk - 2 * kAccel;
+static_assert(kCruise >= 0, "motion profile phases longer than the move");
+
+//acceleration phase, peak velocity and acceleration of a unit move
+static constexpr float kRamp = 2 * kJerk + kAccel;
+static constexpr float kVelocity = 1 / (kRamp + kCruise);
+static constexpr float kAcceleration = kVelocity / (kJerk + kAccel);
+static constexpr float kJerkValue = kAcceleration / kJerk;
+
+/**
+ * @brief Position during the acceleration phase of a unit move
+ *
+ * @param t Time, 0 to kRamp
+ */
+static float ramp(float t)
+{
+    //jerk
+    if (t < kJerk)
+    {
+        return kJerkValue * t * t * t / 6;
+    }
+    float v1 = kAcceleration * kJerk / 2;
+    float p1 = kAcceleration * kJerk * kJerk / 6;
+    //constant acceleration
+    t -= kJerk;
+    if (t < kAccel)
+    {
+        return p1 + v1 * t + kAcceleration * t * t / 2;
+    }
+    float v2 = v1 + kAcceleration * kAccel;
+    float p2 = p1 + v1 * kAccel + kAcceleration * kAccel * kAccel / 2;
+    //negative jerk, up to the cruise velocity
+    t = std::min(t - kAccel, kJerk);
+    return p2 + v2 * t + kAcceleration * t * t / 2 - kJerkValue * t * t * t / 6;
+}
+
+float MotionProfile::shape(float u)
+{
+    u = std::clamp(u, 0.0f, 1.0f);
+    if (u <= kRamp)
+    {
+        return ramp(u);
+    }
+    if (u < kRamp + kCruise)
+    {
+        return ramp(kRamp) + kVelocity * (u - kRamp);
+    }
+    return 1 - ramp(1 - u);
+}
+
+void MotionProfile::plan(Angle from, Angle to, uint32_t duration_us, uint32_t period_us)
+{
+    this->duration_us = duration_us;
+    if (duration_us == 0)
+    {
+        samples[0] = to;
+        count = 1;
+        index_scale = 0;
+        return;
+    }
+    //samples on whole periods from the start, the last one at or past the end
+    uint64_t period = std::max<uint32_t>(period_us, 1);
+    uint64_t stride = (duration_us + period * (kMaxSamples - 1) - 1) / (period * (kMaxSamples - 1));
+    uint64_t spacing = period * std::max<uint64_t>(stride, 1);
+    size_t n = (duration_us + spacing - 1) / spacing + 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        float position = from + (to - from) * shape(float(i * spacing) / duration_us);
+        samples[i] = std::lround(position);
+    }
+    //the ends are exact
+    samples[0] = from;
+    samples[n - 1] = to;
+    count = n;
+    index_scale = (uint64_t(1) << 32) / spacing;
+}
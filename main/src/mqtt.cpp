@@ -1,17 +1,130 @@
 #include "mqtt.hpp"
 #include "config.hpp"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 #include "driver/gpio.h"
 #include "notifications.pb.h"
 #include "commands.pb.h"
 #include "internal_api.hpp"
-
+#include "utils.hpp"
+#include "topic_dispatch.hpp"
+#include "spsc_ring.hpp"
+#include "google/protobuf/arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <string>
 
 static const char *TAG = "MQTT";
 
+static_assert(CONFIG_MQTT_TELEMETRY_SLOT_SIZE <= CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S,
+              "a telemetry message must fit the one second burst of the lane budget");
+
+/**
+ * @brief Telemetry waiting for the telemetry lane task, a copy of the payload
+ */
+struct TelemetryMessage
+{
+    const char *topic; //string literal, not copied
+    int64_t enqueue_us;
+    uint16_t len;
+    uint8_t qos;
+    uint8_t retain;
+    uint8_t data[CONFIG_MQTT_TELEMETRY_SLOT_SIZE];
+};
+
+/**
+ * @brief Telemetry lane, the middleware task produces, the lane task consumes
+ */
+static SpscRing<TelemetryMessage, CONFIG_MQTT_TELEMETRY_LANE_DEPTH, OverflowPolicy::DropOldest> telemetry_lane;
+
+/**
+ * @brief Message being published by the lane task, kept off its stack
+ */
+static TelemetryMessage telemetry_sending;
+
+/**
+ * @brief Queue a decoded command, the queue never blocks the MQTT task
+ *
+ * @param command Command
+ */
+template <typename T>
+static void pushCommand(const T &command)
+{
+    if (!CommandsQueue::push(command))
+    {
+        ESP_LOGW(TAG, "Commands queue is full, command dropped");
+    }
+}
+
+/**
+ * @brief Arena memory for parsing commands, only the MQTT task parses
+ */
+alignas(8) static char arena_block[CONFIG_COMMANDS_ARENA_SIZE];
+
+/**
+ * @brief Parse a command straight from the MQTT event buffer and queue it
+ *
+ * The message lives in an arena on arena_block, parsing does not touch the
+ * heap unless a message outgrows the block.
+ *
+ * @param data Payload
+ * @param data_len Payload length
+ */
+template <typename Message>
+static void parseCommand(const char *data, int data_len)
+{
+    google::protobuf::Arena arena(arena_block, sizeof(arena_block));
+    auto *message = google::protobuf::Arena::CreateMessage<Message>(&arena);
+    if (!message->ParseFromArray(data, data_len))
+    {
+        ESP_LOGW(TAG, "Malformed command dropped");
+        return;
+    }
+#ifdef CONFIG_COMMANDS_DEBUG_DUMP
+    ESP_LOGI(TAG, "%s", message->ShortDebugString().c_str());
+#endif
+    pushCommand(Command::decode(*message));
+}
+
+/**
+ * @brief Command topics and their decoders, dispatched from this table only
+ */
+struct CommandRoute
+{
+    const char *topic;
+    void (*parse)(const char *data, int data_len);
+};
+
+static constexpr CommandRoute kCommandRoutes[] = {
+    {MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE, parseCommand<Commands::ServoGoToAngle>},
+    {MQTT_TOPIC_COMMANDS_SERVO_LOCK, parseCommand<Commands::ServoLock>},
+    {MQTT_TOPIC_COMMANDS_SERVO_UNLOCK, parseCommand<Commands::ServoUnLock>},
+    {MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE, parseCommand<Commands::ServoSmoothlyMove>},
+    {MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE, parseCommand<Commands::MoveToTargetPressure>},
+    {MQTT_TOPIC_COMMANDS_HOLD_GESTURE, parseCommand<Commands::HoldGesture>},
+};
+
+static constexpr size_t kCommandRoutesCount = std::size(kCommandRoutes);
+
+static constexpr TopicDispatcher<kCommandRoutesCount> command_dispatcher(
+    MQTT_TOPIC_COMMANDS "/",
+    []
+    {
+        std::array<std::string_view, kCommandRoutesCount> topics;
+        for (size_t i = 0; i < kCommandRoutesCount; i++)
+        {
+            topics[i] = kCommandRoutes[i].topic;
+        }
+        return topics;
+    }());
+
+static_assert(command_dispatcher.valid(), "command topics must be unique and below MQTT_TOPIC_COMMANDS");
+
 /**
  * @brief MqttClient instance
  */
@@ -44,6 +157,10 @@ MqttClient::MqttClient()
     mqtt_cfg.credentials.authentication.password = password.c_str();
     mqtt_cfg.session.keepalive = CONFIG_MQTT_KEEP_ALIVE_TIME;
     mqtt_cfg.buffer.size = 20 * 1024;
+    // Reconnects are scheduled by reconnect_timer, see scheduleReconnect()
+    mqtt_cfg.network.disable_auto_reconnect = true;
+
+    this->reconnect_timer = xTimerCreate("mqtt_reconnect", 1, pdFALSE, this, MqttClient::reconnectTimerCallback);
 
     this->mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     err = esp_mqtt_client_start(this->mqtt_client);
@@ -56,6 +173,11 @@ MqttClient::MqttClient()
 MqttClient::~MqttClient()
 {
     esp_mqtt_client_unregister_event(this->mqtt_client, MQTT_EVENT_ANY, MqttClient::eventHandler);
+    xTimerDelete(this->reconnect_timer, 0);
+    if (this->reconnect_task)
+    {
+        vTaskDelete(this->reconnect_task);
+    }
     esp_mqtt_client_disconnect(this->mqtt_client);
     esp_mqtt_client_destroy(this->mqtt_client);
 
@@ -79,7 +201,6 @@ MqttClient::~MqttClient()
 void MqttClient::eventHandler(void *handler_args, esp_event_base_t base,
                               int32_t event_id, void *event_data)
 {
-    esp_err_t err;
     esp_mqtt_event_handle_t mqtt_event;
     mqtt_event = static_cast<esp_mqtt_event_handle_t>(event_data);
 
@@ -87,31 +208,42 @@ void MqttClient::eventHandler(void *handler_args, esp_event_base_t base,
     {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+        MqttClient::getInstance().connack_us = esp_timer_get_time();
+        MqttClient::getInstance().awaiting_first_command = true;
+        MqttClient::getInstance().onConnected();
         // Turn on ACS led
+        // Subscribe MQTT topics first, commands flow one round trip later
+        MqttClient::getInstance().subscribeTopics();
         // Send init message
         MqttClient::getInstance().sendInitMessage();
         // Send not sended events
-        // Subscribe MQTT topics
-        MqttClient::getInstance().subscribeTopics();
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
-        vTaskDelay(pdMS_TO_TICKS(CONFIG_WIFI_RECONNECT_TIMEOUT));
-        err = esp_mqtt_client_reconnect(MqttClient::getInstance().getClient());
-        ESP_LOGE(TAG, "mqtt reconnect returned error %d", err);
-        [[fallthrough]];
+        MqttClient::getInstance().controlReset();
+        MqttClient::getInstance().scheduleReconnect();
+        break;
     case MQTT_EVENT_SUBSCRIBED:
-        [[fallthrough]];
+        if (mqtt_event->msg_id == MqttClient::getInstance().subscribe_msg_id)
+        {
+            ESP_LOGI(TAG, "commands subscribed, SUBACK %lld us after CONNACK",
+                     (long long)(esp_timer_get_time() - MqttClient::getInstance().connack_us));
+        }
+        break;
     case MQTT_EVENT_UNSUBSCRIBED:
-        [[fallthrough]];
+        break;
     case MQTT_EVENT_PUBLISHED:
+        [[fallthrough]];
+    case MQTT_EVENT_DELETED:
+        // PUBACK, or the outbox gave up on the message
+        MqttClient::getInstance().controlAcked(mqtt_event->msg_id);
         break;
     case MQTT_EVENT_DATA:
         MqttClient::getInstance().dataHandler(mqtt_event->topic, mqtt_event->topic_len,
                                               mqtt_event->data, mqtt_event->data_len);
         break;
     case MQTT_EVENT_ERROR:
-        ESP_LOGI(TAG, "in mqtt error heap size: %ld", esp_get_free_heap_size());
+        ESP_LOGI(TAG, "in mqtt error heap size: %lu", (unsigned long)esp_get_free_heap_size());
         ESP_LOGE(TAG, "MQTT_EVENT_ERROR");
         break;
     default:
@@ -119,6 +251,474 @@ void MqttClient::eventHandler(void *handler_args, esp_event_base_t base,
     }
 }
 
+/**
+ * @brief Delay of a reconnect attempt
+ *
+ * Exponential backoff with "equal jitter": the delay doubles with every
+ * attempt up to the maximum, then a random part of up to half of it is
+ * taken off.
+ *
+ * @param attempt Attempts since the connection was lost, from 0
+ * @return uint32_t Delay, ms
+ */
+static uint32_t reconnectDelay(uint32_t attempt)
+{
+    uint32_t delay = CONFIG_MQTT_RECONNECT_BACKOFF_MIN_MS;
+    for (uint32_t i = 0; i < attempt && delay < CONFIG_MQTT_RECONNECT_BACKOFF_MAX_MS; i++)
+    {
+        delay *= 2;
+    }
+    delay = std::min<uint32_t>(delay, CONFIG_MQTT_RECONNECT_BACKOFF_MAX_MS);
+    return delay - esp_random() % (delay / 2 + 1);
+}
+
+/**
+ * @brief Arm the reconnect timer, called on MQTT_EVENT_DISCONNECTED
+ *
+ * esp-mqtt reports a lost connection and every failed attempt with
+ * MQTT_EVENT_DISCONNECTED, each one schedules the next attempt. The MQTT
+ * task returns immediately, the timer wakes the reconnect task for the attempt.
+ */
+void MqttClient::scheduleReconnect()
+{
+    if (connected)
+    {
+        connected = false;
+        reconnect_attempt = 0;
+        disconnected_at_us = esp_timer_get_time();
+    }
+    uint32_t delay = reconnectDelay(reconnect_attempt++);
+    ESP_LOGI(TAG, "reconnect attempt %lu in %lu ms", (unsigned long)reconnect_attempt, (unsigned long)delay);
+    if (xTimerChangePeriod(reconnect_timer, std::max<TickType_t>(pdMS_TO_TICKS(delay), 1), 0) != pdPASS)
+    {
+        ESP_LOGE(TAG, "reconnect timer not armed");
+    }
+}
+
+/**
+ * @brief Reconnect timer, runs on the FreeRTOS timer task
+ *
+ * Only wakes the reconnect task: esp_mqtt_client_reconnect() takes the
+ * client lock, which would hold every other timer of the firmware.
+ *
+ * @param timer reconnect_timer
+ */
+void MqttClient::reconnectTimerCallback(TimerHandle_t timer)
+{
+    auto *client = static_cast<MqttClient *>(pvTimerGetTimerID(timer));
+    xTaskNotifyGive(client->reconnect_task);
+}
+
+/**
+ * @brief Reconnect task, starts an attempt every time the reconnect timer fires
+ *
+ * @param pvParameters MqttClient
+ */
+void MqttClient::reconnectTask(void *pvParameters)
+{
+    auto *client = static_cast<MqttClient *>(pvParameters);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        client->attempt_us = esp_timer_get_time();
+        client->attempts++;
+        esp_err_t err = esp_mqtt_client_reconnect(client->mqtt_client);
+        if (err != ESP_OK)
+        {
+            // no MQTT_EVENT_DISCONNECTED follows, retry after the same delay
+            ESP_LOGE(TAG, "mqtt reconnect returned error %d", err);
+            xTimerReset(client->reconnect_timer, 0);
+        }
+    }
+}
+
+/**
+ * @brief Update reconnect statistics, called on MQTT_EVENT_CONNECTED
+ */
+void MqttClient::onConnected()
+{
+    connected = true;
+    reconnect_attempt = 0;
+    // telemetry held back while offline goes out now
+    if (telemetry_task)
+    {
+        xTaskNotifyGive(telemetry_task);
+    }
+    reconnect_stats.attempts = attempts;
+    if (disconnected_at_us == 0)
+    {
+        // first connection, nothing was lost
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    reconnect_stats.reconnects++;
+    reconnect_stats.last_connect_us = now - attempt_us;
+    reconnect_stats.last_outage_us = now - disconnected_at_us;
+    reconnect_stats.disconnected_total_us += reconnect_stats.last_outage_us;
+    disconnected_at_us = 0;
+    ESP_LOGI(TAG, "reconnected after %lld us offline, CONNACK %lld us after the attempt",
+             (long long)reconnect_stats.last_outage_us, (long long)reconnect_stats.last_connect_us);
+}
+
+/**
+ * @brief Get reconnect statistics
+ *
+ * Updated by the MQTT task, a copy taken from another task may mix two updates
+ *
+ * @return ReconnectStats
+ */
+MqttClient::ReconnectStats MqttClient::getReconnectStats() const
+{
+    return reconnect_stats;
+}
+
+/**
+ * @brief Reserve a control lane slot for a message about to be published
+ *
+ * When all slots await a PUBACK, the ones older than the keepalive are
+ * taken back, their PUBACK is not coming on this connection any more.
+ *
+ * @param now_us Time of the send call
+ * @return int Slot index, -1 if all slots are in flight
+ */
+int MqttClient::reserveControl(int64_t now_us)
+{
+    int slot = -1;
+    uint32_t depth = 0;
+    for (int i = 0; i < CONFIG_MQTT_CONTROL_MAX_INFLIGHT; i++)
+    {
+        ControlMessage &message = control_inflight[i];
+        if (message.msg_id != 0 && now_us - message.sent_us > CONFIG_MQTT_KEEP_ALIVE_TIME * 1000000LL)
+        {
+            message.msg_id = 0;
+        }
+        if (message.msg_id == 0)
+        {
+            if (slot < 0)
+            {
+                slot = i;
+            }
+            continue;
+        }
+        depth++;
+    }
+    if (slot < 0)
+    {
+        control_stats.dropped++;
+        return -1;
+    }
+    // -1 until the publish call returns the msg_id
+    control_inflight[slot] = {-1, now_us};
+    control_publishing++;
+    control_stats.depth = depth + 1;
+    control_stats.depth_high_water = std::max(control_stats.depth_high_water, control_stats.depth);
+    return slot;
+}
+
+/**
+ * @brief Free the control lane slot of a message, MQTT task
+ *
+ * @param msg_id MQTT_EVENT_PUBLISHED or MQTT_EVENT_DELETED message id
+ */
+void MqttClient::controlAcked(int msg_id)
+{
+    control_mutex.lock();
+    bool found = false;
+    for (auto &message : control_inflight)
+    {
+        if (message.msg_id == msg_id)
+        {
+            message.msg_id = 0;
+            control_stats.depth--;
+            found = true;
+            break;
+        }
+    }
+    // telemetry with QoS > 0, or a control message still in its publish call.
+    // Without a publish in its call it can only be telemetry. With more than
+    // kControlEarlyAcks in one call the oldest are overwritten, a control
+    // slot whose PUBACK is lost so is taken back after the keepalive.
+    if (!found && control_publishing > 0)
+    {
+        control_early_acks[control_early_next++ % kControlEarlyAcks] = msg_id;
+    }
+    control_mutex.unlock();
+}
+
+/**
+ * @brief Free all control lane slots, called on MQTT_EVENT_DISCONNECTED
+ *
+ * Unacknowledged messages stay in the esp-mqtt outbox and are resent after
+ * the reconnect, they no longer hold back new control messages.
+ */
+void MqttClient::controlReset()
+{
+    control_mutex.lock();
+    for (auto &message : control_inflight)
+    {
+        message.msg_id = 0;
+    }
+    control_stats.depth = 0;
+    std::fill(std::begin(control_early_acks), std::end(control_early_acks), 0);
+    control_mutex.unlock();
+}
+
+/**
+ * @brief Send a control message (notification, ack) on the control lane
+ *
+ * Published with the notifications policy from the calling task, it never
+ * waits behind telemetry. At most CONFIG_MQTT_CONTROL_MAX_INFLIGHT messages await their
+ * PUBACK, further ones are refused.
+ *
+ * @param topic MQTT topic
+ * @param data Payload
+ * @param len Payload length
+ * @return int Message ID on success, -1 if refused or the publish failed
+ */
+int MqttClient::sendControl(const char *topic, const char *data, int len)
+{
+    int64_t start_us = esp_timer_get_time();
+    control_mutex.lock();
+    int slot = reserveControl(start_us);
+    control_mutex.unlock();
+    if (slot < 0)
+    {
+        ESP_LOGW(TAG, "control lane full, %s dropped", topic);
+        return -1;
+    }
+
+    constexpr TopicPolicy notifications = policy(TopicClass::Notifications);
+    int msg_id = esp_mqtt_client_publish(this->mqtt_client, topic, data, len,
+                                         notifications.qos, notifications.retain);
+    uint32_t queue_us = esp_timer_get_time() - start_us;
+
+    control_mutex.lock();
+    control_publishing--;
+    bool acked = false;
+    for (int &early_ack : control_early_acks)
+    {
+        if (msg_id > 0 && early_ack == msg_id)
+        {
+            early_ack = 0;
+            acked = true;
+        }
+    }
+    if (control_publishing == 0)
+    {
+        // no PUBACK kept now belongs to a control message
+        std::fill(std::begin(control_early_acks), std::end(control_early_acks), 0);
+    }
+    ControlMessage &message = control_inflight[slot];
+    // unless controlReset() took the slot back meanwhile
+    if (message.msg_id == -1 && message.sent_us == start_us)
+    {
+        if (msg_id <= 0 || acked)
+        {
+            message.msg_id = 0;
+            control_stats.depth--;
+        }
+        else
+        {
+            message.msg_id = msg_id;
+        }
+    }
+    if (msg_id < 0)
+    {
+        control_stats.failed++;
+    }
+    else
+    {
+        control_stats.sent++;
+    }
+    control_queue_us_total += queue_us;
+    control_stats.queue_us_max = std::max(control_stats.queue_us_max, queue_us);
+    control_mutex.unlock();
+    return msg_id;
+}
+
+/**
+ * @brief Queue telemetry on the telemetry lane
+ *
+ * The payload is copied, the lane task publishes it within the lane budget
+ * once connected. When the lane is full the oldest message is dropped.
+ * Only one task may send telemetry.
+ *
+ * @param topic MQTT topic, must outlive the message (a string literal)
+ * @param data Payload
+ * @param len Payload length, at most CONFIG_MQTT_TELEMETRY_SLOT_SIZE
+ * @param qos QOS
+ * @param retain Retain flag
+ * @return true - queued
+ * @return false - payload larger than a lane slot
+ */
+bool MqttClient::sendTelemetry(const char *topic, const uint8_t *data, size_t len, int qos, int retain)
+{
+    if (len > CONFIG_MQTT_TELEMETRY_SLOT_SIZE)
+    {
+        ESP_LOGE(TAG, "%u bytes do not fit a telemetry slot", (unsigned)len);
+        return false;
+    }
+    // too large for the caller's stack, only one task sends telemetry
+    static TelemetryMessage message;
+    message.topic = topic;
+    message.enqueue_us = esp_timer_get_time();
+    message.len = len;
+    message.qos = qos;
+    message.retain = retain;
+    memcpy(message.data, data, len);
+    telemetry_lane.push(message);
+    if (telemetry_task)
+    {
+        xTaskNotifyGive(telemetry_task);
+    }
+    return true;
+}
+
+/**
+ * @brief Free telemetry lane slots, producer side
+ *
+ * @return size_t Messages that can be queued without dropping any
+ */
+size_t MqttClient::telemetrySpace() const
+{
+    return telemetry_lane.capacity() - telemetry_lane.size();
+}
+
+/**
+ * @brief Wait until the lane budget covers len bytes and spend them
+ *
+ * Token bucket refilled at CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S, holding
+ * one second worth at most.
+ *
+ * @param len Payload length
+ */
+void MqttClient::spendTelemetryBudget(size_t len)
+{
+    for (;;)
+    {
+        int64_t now_us = esp_timer_get_time();
+        telemetry_tokens = std::min<int64_t>(
+            telemetry_tokens + (now_us - telemetry_refill_us) * CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S / 1000000,
+            CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S);
+        telemetry_refill_us = now_us;
+        if (telemetry_tokens >= (int64_t)len)
+        {
+            telemetry_tokens -= len;
+            return;
+        }
+        int64_t wait_ms = (len - telemetry_tokens) * 1000 / CONFIG_MQTT_TELEMETRY_BUDGET_BYTES_PER_S + 1;
+        vTaskDelay(std::max<TickType_t>(pdMS_TO_TICKS(wait_ms), 1));
+    }
+}
+
+/**
+ * @brief Publish queued telemetry while connected, lane task
+ */
+void MqttClient::drainTelemetry()
+{
+    while (connected && telemetry_lane.pop(telemetry_sending))
+    {
+        spendTelemetryBudget(telemetry_sending.len);
+        int msg_id = esp_mqtt_client_publish(this->mqtt_client, telemetry_sending.topic,
+                                             reinterpret_cast<const char *>(telemetry_sending.data),
+                                             telemetry_sending.len, telemetry_sending.qos,
+                                             telemetry_sending.retain);
+        uint32_t queue_us = esp_timer_get_time() - telemetry_sending.enqueue_us;
+        if (msg_id < 0)
+        {
+            telemetry_stats.failed++;
+        }
+        else
+        {
+            telemetry_stats.sent++;
+        }
+        telemetry_queue_us_total += queue_us;
+        telemetry_stats.queue_us_max = std::max(telemetry_stats.queue_us_max, queue_us);
+    }
+}
+
+/**
+ * @brief Telemetry lane task
+ *
+ * Woken by sendTelemetry() and by CONNACK. While offline messages stay in
+ * the lane, the oldest ones are overwritten.
+ *
+ * @param pvParameters MqttClient
+ */
+void MqttClient::telemetryLaneTask(void *pvParameters)
+{
+    auto *client = static_cast<MqttClient *>(pvParameters);
+    client->telemetry_refill_us = esp_timer_get_time();
+#if CONFIG_MQTT_LANE_REPORT_PERIOD > 0
+    int64_t report_us = client->telemetry_refill_us;
+#endif
+    for (;;)
+    {
+#if CONFIG_MQTT_LANE_REPORT_PERIOD > 0
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_MQTT_LANE_REPORT_PERIOD * 1000));
+#else
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#endif
+        client->drainTelemetry();
+#if CONFIG_MQTT_LANE_REPORT_PERIOD > 0
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - report_us >= CONFIG_MQTT_LANE_REPORT_PERIOD * 1000000LL)
+        {
+            report_us = now_us;
+            client->logLanes();
+        }
+#endif
+    }
+}
+
+/**
+ * @brief Log the metrics of both lanes
+ */
+void MqttClient::logLanes()
+{
+    LaneStats control = getLaneStats(Lane::Control);
+    LaneStats telemetry = getLaneStats(Lane::Telemetry);
+    ESP_LOGI(TAG, "control lane: sent %lu, refused %lu, failed %lu, in flight %lu (max %lu), publish us mean %lu max %lu",
+             (unsigned long)control.sent, (unsigned long)control.dropped, (unsigned long)control.failed,
+             (unsigned long)control.depth, (unsigned long)control.depth_high_water,
+             (unsigned long)control.queue_us_mean, (unsigned long)control.queue_us_max);
+    ESP_LOGI(TAG, "telemetry lane: sent %lu, dropped %lu, failed %lu, depth %lu (max %lu), queue us mean %lu max %lu",
+             (unsigned long)telemetry.sent, (unsigned long)telemetry.dropped, (unsigned long)telemetry.failed,
+             (unsigned long)telemetry.depth, (unsigned long)telemetry.depth_high_water,
+             (unsigned long)telemetry.queue_us_mean, (unsigned long)telemetry.queue_us_max);
+}
+
+/**
+ * @brief Get lane metrics, counted since init
+ *
+ * Updated by other tasks, a copy may mix two updates
+ *
+ * @param lane Lane
+ * @return LaneStats
+ */
+MqttClient::LaneStats MqttClient::getLaneStats(Lane lane) const
+{
+    LaneStats stats;
+    uint64_t queue_us_total;
+    if (lane == Lane::Control)
+    {
+        stats = control_stats;
+        queue_us_total = control_queue_us_total;
+    }
+    else
+    {
+        auto ring = telemetry_lane.stats();
+        stats = telemetry_stats;
+        stats.dropped = ring.dropped;
+        stats.depth = telemetry_lane.size();
+        stats.depth_high_water = ring.high_water;
+        queue_us_total = telemetry_queue_us_total;
+    }
+    uint32_t published = stats.sent + stats.failed;
+    stats.queue_us_mean = published ? queue_us_total / published : 0;
+    return stats;
+}
+
 /**
  * @brief MQTT_EVENT_DATA handler
  *
@@ -129,8 +729,6 @@ void MqttClient::eventHandler(void *handler_args, esp_event_base_t base,
  */
 void MqttClient::dataHandler(char *topic, int topic_len, char *data, int data_len)
 {
-    int err;
-
     if (topic_len <= 0)
     {
         ESP_LOGE(TAG, "Topic with zero length");
@@ -139,46 +737,18 @@ void MqttClient::dataHandler(char *topic, int topic_len, char *data, int data_le
 
     ESP_LOGD(TAG, "TOPIC=%.*s", topic_len, topic);
 
-    std::string mqtt_topic(topic, topic_len);
-
-    std::string message_str(data, data_len);
-
-    // Change door mode
-    if (mqtt_topic == MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE){
-        Commands::ServoGoToAngle message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
-    }
-    else if (mqtt_topic == MQTT_TOPIC_COMMANDS_SERVO_LOCK){
-        Commands::ServoLock message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
-    }
-    else if (mqtt_topic == MQTT_TOPIC_COMMANDS_SERVO_UNLOCK){
-        Commands::ServoUnLock message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
-    }
-    else if (mqtt_topic == MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE){
-        Commands::ServoSmoothlyMove message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
-    }
-    else if (mqtt_topic == MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE){
-        Commands::MoveToTargetPressure message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
-    }
-    else if (mqtt_topic == MQTT_TOPIC_COMMANDS_HOLD_GESTURE){
-        Commands::HoldGesture message;
-        message.ParseFromString(message_str);
-        std::cout << message.DebugString() << std::endl;
-        CommandsQueue::push(message);
+    int route = command_dispatcher.find(topic, topic_len);
+    if (route < 0)
+    {
+        ESP_LOGD(TAG, "No handler for topic");
+        return;
+    }
+    kCommandRoutes[route].parse(data, data_len);
+
+    if (awaiting_first_command)
+    {
+        awaiting_first_command = false;
+        ESP_LOGI(TAG, "first command %lld us after CONNACK", (long long)(esp_timer_get_time() - connack_us));
     }
 }
 
@@ -224,12 +794,12 @@ int MqttClient::send(const char *topic, const char *data, int len, int qos, int
  */
 void MqttClient::sendInitMessage()
 {
+    static uint8_t buffer[16];
     Notifications::Notification notification;
     notification.set_notification(Notifications::NotificationType::connected);
-    std::string message;
-    notification.SerializeToString(&message);
-    
-    this->send(MQTT_TOPIC_NOTIFICATIONS, message.data(), message.size(), CONFIG_MQTT_QOS_LEVEL, 0);
+    size_t size = serializeToBuffer(notification, buffer);
+
+    this->sendControl(MQTT_TOPIC_NOTIFICATIONS, reinterpret_cast<const char *>(buffer), size);
 }
 
 /**
@@ -237,25 +807,11 @@ void MqttClient::sendInitMessage()
  */
 void MqttClient::subscribeTopics()
 {
-    int msg_id;
-
-    std::string topics[] = {
-        std::string(MQTT_TOPIC_COMMANDS),
-        std::string(MQTT_TOPIC_COMMANDS_SERVO_GO_TO_ANGLE),
-        std::string(MQTT_TOPIC_COMMANDS_SERVO_LOCK),
-        std::string(MQTT_TOPIC_COMMANDS_SERVO_UNLOCK),
-        std::string(MQTT_TOPIC_COMMANDS_SERVO_SMOOTHLY_MOVE),
-        std::string(MQTT_TOPIC_COMMANDS_MOVE_TARGET_PRESSURE),
-        std::string(MQTT_TOPIC_COMMANDS_HOLD_GESTURE),
-    };
-    //todo #0
-
-    // Subscribe all topics
-    for (std::string topic : topics)
-    {
-        msg_id = esp_mqtt_client_subscribe(this->mqtt_client, topic.c_str(), CONFIG_MQTT_QOS_LEVEL);
-        ESP_LOGD(TAG, "subscribe successful %s, msg_id=%d", topic.c_str(), msg_id);
-    }
+    // One wildcard subscription, dataHandler routes through kCommandRoutes.
+    // The SUBACK is not waited for, it is logged from the event handler
+    subscribe_msg_id = esp_mqtt_client_subscribe(this->mqtt_client, MQTT_TOPIC_COMMANDS_ALL,
+                                                 policy(TopicClass::Commands).qos);
+    ESP_LOGD(TAG, "subscribe sent %s, msg_id=%d", MQTT_TOPIC_COMMANDS_ALL, subscribe_msg_id);
 }
 
 
@@ -294,8 +850,13 @@ void MqttClient::init()
     if (!p_instance)
     {
         p_instance = new MqttClient();
+        // before the events, the first MQTT_EVENT_DISCONNECTED arms the timer that wakes it
+        xTaskCreate(MqttClient::reconnectTask, "MqttReconnect", 3072, p_instance, 5,
+                    &p_instance->reconnect_task);
         err = esp_mqtt_client_register_event(MqttClient::getInstance().getClient(), MQTT_EVENT_ANY,
                                              MqttClient::eventHandler, static_cast<void *>(p_instance));
         ESP_LOGD(TAG, "esp_mqtt_client_register_event: %d", err);
+        xTaskCreate(MqttClient::telemetryLaneTask, "MqttTelemetry", 3072, p_instance, 4,
+                    &p_instance->telemetry_task);
     }
 }
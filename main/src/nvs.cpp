@@ -37,7 +37,11 @@ Nvs::Nvs()
  */
 Nvs::~Nvs()
 {
-    delete p_instance;
+    //only the singleton itself is forgotten, a temporary from init() is not
+    if (p_instance == this)
+    {
+        p_instance = nullptr;
+    }
 }
 
 /**
@@ -0,0 +1,98 @@
+#include "pressure.hpp"
+#include "Arduino.h"
+#include "acquisition.hpp"
+#include "esp_timer.h"
+#include "hand_topology.hpp"
+#include "internal_api.hpp"
+
+#include <algorithm>
+
+using Angle = PressureController::Angle;
+
+static constexpr Angle kOne = MotionProfile::kOne;
+static constexpr Angle kMaxAngle = CONFIG_SERVO_MAX_ANGLE * kOne;
+static constexpr Angle kMaxStep = CONFIG_CONTROL_MAX_SPEED_DEG_S * kOne / CONFIG_CONTROL_RATE_HZ;
+
+//gains, Q16 of Q8 degrees per gauge unit, per tick where time is involved
+static constexpr int64_t kKp = int64_t(CONFIG_CONTROL_PRESSURE_KP_MILLI) * kOne * 65536 / 1000;
+static constexpr int64_t kKi = int64_t(CONFIG_CONTROL_PRESSURE_KI_MILLI) * kOne * 65536 / 1000 / CONFIG_CONTROL_RATE_HZ;
+static constexpr int64_t kKd = int64_t(CONFIG_CONTROL_PRESSURE_KD_MILLI) * kOne * 65536 / 1000 * CONFIG_CONTROL_RATE_HZ;
+
+static_assert(kMaxStep > 0, "pressure control speed below one Q8 step per tick");
+
+/**
+ * @brief Loop state of one finger
+ */
+struct FingerLoop
+{
+    uint32_t target;
+    Angle base;       //angle when engaged
+    int64_t integral; //Q16 of Q8 degrees
+    uint16_t previous;
+    bool first;
+};
+
+static FingerLoop loops[HandTopology::kFingers];
+static PressureController::Stats counters = {};
+
+//strain gauges in storage order
+static constexpr auto kGauges = []()
+{
+    std::array<HandTopology::Sensor, HandLayout::kStrainGauges> gauges = {};
+    for (size_t i = 0; i < gauges.size(); i++)
+    {
+        gauges[i] = HandTopology::sensor(HandTopology::SensorKind::StrainGauge, i);
+    }
+    return gauges;
+}();
+
+void PressureController::init()
+{
+    SensorAcquisition::configure();
+}
+
+void PressureController::acquire(uint16_t *pressures)
+{
+    int64_t start_us = esp_timer_get_time();
+    for (size_t i = 0; i < kGauges.size(); i++)
+    {
+        SensorAcquisition::select(kGauges[i].mux, kGauges[i].channel);
+        pressures[i] = analogRead(HandTopology::kMuxes[kGauges[i].mux].sig);
+    }
+    counters.acquisitions++;
+    counters.acquisition_us_max = std::max<uint32_t>(counters.acquisition_us_max, esp_timer_get_time() - start_us);
+}
+
+void PressureController::engage(size_t finger, uint32_t pressure, Angle angle)
+{
+    loops[finger] = {pressure, angle, 0, 0, true};
+}
+
+Angle PressureController::step(size_t finger, uint16_t pressure, Angle angle)
+{
+    FingerLoop &loop = loops[finger];
+    int64_t error = int64_t(loop.target) - pressure;
+    int64_t integral = loop.integral + error * kKi;
+    int64_t derivative = loop.first ? 0 : -((int64_t(pressure) - loop.previous) * kKd);
+    loop.previous = pressure;
+    loop.first = false;
+
+    int64_t desired = loop.base + ((error * kKp + integral + derivative) >> 16);
+    Angle limited = std::clamp<int64_t>(desired, std::max(angle - kMaxStep, 0), std::min(angle + kMaxStep, kMaxAngle));
+    counters.steps++;
+    //held by a limit and the error pushes further: keep the integral
+    if ((desired > limited && error > 0) || (desired < limited && error < 0))
+    {
+        counters.saturated++;
+    }
+    else
+    {
+        loop.integral = integral;
+    }
+    return limited;
+}
+
+PressureController::Stats PressureController::stats()
+{
+    return counters;
+}
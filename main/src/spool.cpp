@@ -0,0 +1,288 @@
+#include "spool.hpp"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "SPOOL";
+
+/**
+ * @brief Mount the spool
+ *
+ * The head is the sector with the highest sequence, the tail the first
+ * pending record walking from the sector after the head (the oldest one)
+ * around to the head. Every record header is read once.
+ *
+ * @param label Partition label
+ * @return esp_err_t
+ */
+esp_err_t Spool::mount(const char *label)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr)
+    {
+        ESP_LOGE(TAG, "no partition %s", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    sector_size = partition->erase_size;
+    sectors = partition->size / sector_size;
+    if (sectors < 2)
+    {
+        partition = nullptr;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    counters = {};
+    peeked_size = 0;
+
+    bool found = false;
+    for (uint32_t sector = 0; sector < sectors; sector++)
+    {
+        SectorHeader header;
+        if (readSector(sector, header) && (!found || header.sequence > head_sequence))
+        {
+            found = true;
+            head_sector = sector;
+            head_sequence = header.sequence;
+        }
+    }
+    if (!found)
+    {
+        ESP_LOGI(TAG, "empty, %lu sectors", (unsigned long)sectors);
+        esp_err_t err = startSector(0, 1);
+        tail_sector = head_sector;
+        tail_offset = head_offset;
+        return err;
+    }
+
+    RecordHeader record;
+    head_offset = sizeof(SectorHeader);
+    while (readRecord(head_sector, head_offset, record))
+    {
+        head_offset += recordSize(record.length);
+    }
+    if (record.length != kFree)
+    {
+        //torn header, nothing more is written to this sector
+        head_offset = sector_size;
+    }
+
+    tail_sector = head_sector;
+    tail_offset = head_offset;
+    bool tail_found = false;
+    for (uint32_t i = 1; i <= sectors; i++)
+    {
+        uint32_t sector = (head_sector + i) % sectors;
+        SectorHeader header;
+        if (!readSector(sector, header))
+        {
+            continue;
+        }
+        for (uint32_t offset = sizeof(SectorHeader);
+             (sector != head_sector || offset < head_offset) && readRecord(sector, offset, record);
+             offset += recordSize(record.length))
+        {
+            if (record.state != kPending)
+            {
+                continue;
+            }
+            if (!tail_found)
+            {
+                tail_found = true;
+                tail_sector = sector;
+                tail_offset = offset;
+            }
+            counters.pending++;
+        }
+    }
+    ESP_LOGI(TAG, "mounted, head sector %lu, %lu records pending", (unsigned long)head_sector,
+             (unsigned long)counters.pending);
+    return ESP_OK;
+}
+
+/**
+ * @brief Append a record, erasing the next sector when the head one is full
+ *
+ * @param data Record
+ * @param size Record size
+ * @return esp_err_t
+ */
+esp_err_t Spool::append(const uint8_t *data, size_t size)
+{
+    if (partition == nullptr)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t needed = recordSize(size);
+    if (size >= kFree || needed > sector_size - sizeof(SectorHeader))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (head_offset + needed > sector_size)
+    {
+        bool empty = tailAtHead();
+        uint32_t next = (head_sector + 1) % sectors;
+        if (!empty && tail_sector == next)
+        {
+            //ring full, the oldest sector goes with its pending records
+            RecordHeader record;
+            for (uint32_t offset = tail_offset; readRecord(next, offset, record); offset += recordSize(record.length))
+            {
+                if (record.state == kPending)
+                {
+                    counters.dropped++;
+                    counters.pending--;
+                }
+            }
+            tail_sector = (next + 1) % sectors;
+            tail_offset = sizeof(SectorHeader);
+            peeked_size = 0;
+        }
+        esp_err_t err = startSector(next, head_sequence + 1);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (empty)
+        {
+            tail_sector = head_sector;
+            tail_offset = head_offset;
+        }
+    }
+
+    RecordHeader header = {uint16_t(size), kPending, esp_rom_crc32_le(0, data, size)};
+    size_t address = head_sector * sector_size + head_offset;
+    //a failed write leaves a torn record behind, it is skipped like one
+    head_offset += needed;
+    esp_err_t err = esp_partition_write(partition, address, &header, sizeof(header));
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(partition, address + sizeof(header), data, size);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "write failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    counters.appended++;
+    counters.pending++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Copy the oldest pending record, records failing the crc are skipped
+ *
+ * @param buffer Output buffer
+ * @param size Output buffer size
+ * @return size_t Record size, 0 if nothing is pending
+ */
+size_t Spool::peek(uint8_t *buffer, size_t size)
+{
+    while (partition != nullptr && !tailAtHead())
+    {
+        RecordHeader header;
+        if (!readRecord(tail_sector, tail_offset, header))
+        {
+            advanceTail(0);
+            continue;
+        }
+        uint32_t record_size = recordSize(header.length);
+        if (header.state != kPending)
+        {
+            advanceTail(record_size);
+            continue;
+        }
+        if (header.length > size)
+        {
+            ESP_LOGW(TAG, "record of %u bytes does not fit the buffer", header.length);
+            return 0;
+        }
+        size_t address = tail_sector * sector_size + tail_offset;
+        if (esp_partition_read(partition, address + sizeof(header), buffer, header.length) != ESP_OK)
+        {
+            return 0;
+        }
+        peeked_size = record_size;
+        if (esp_rom_crc32_le(0, buffer, header.length) != header.crc)
+        {
+            counters.corrupted++;
+            consume();
+            continue;
+        }
+        return header.length;
+    }
+    return 0;
+}
+
+/**
+ * @brief Mark the peeked record replayed and move to the next one
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE if nothing was peeked
+ */
+esp_err_t Spool::pop()
+{
+    if (peeked_size == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    counters.replayed++;
+    return consume();
+}
+
+esp_err_t Spool::consume()
+{
+    uint16_t state = kReplayed;
+    size_t address = tail_sector * sector_size + tail_offset + offsetof(RecordHeader, state);
+    esp_err_t err = esp_partition_write(partition, address, &state, sizeof(state));
+    advanceTail(peeked_size);
+    peeked_size = 0;
+    counters.pending--;
+    return err;
+}
+
+bool Spool::readSector(uint32_t sector, SectorHeader &header)
+{
+    return esp_partition_read(partition, sector * sector_size, &header, sizeof(header)) == ESP_OK &&
+           header.magic == kMagic;
+}
+
+bool Spool::readRecord(uint32_t sector, uint32_t offset, RecordHeader &header)
+{
+    if (offset + sizeof(RecordHeader) > sector_size ||
+        esp_partition_read(partition, sector * sector_size + offset, &header, sizeof(header)) != ESP_OK)
+    {
+        header.length = kFree;
+        return false;
+    }
+    return header.length != kFree && offset + recordSize(header.length) <= sector_size;
+}
+
+esp_err_t Spool::startSector(uint32_t sector, uint32_t sequence)
+{
+    esp_err_t err = esp_partition_erase_range(partition, sector * sector_size, sector_size);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "erase failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    counters.erases++;
+    SectorHeader header = {kMagic, sequence};
+    head_sector = sector;
+    head_sequence = sequence;
+    head_offset = sizeof(header);
+    return esp_partition_write(partition, sector * sector_size, &header, sizeof(header));
+}
+
+void Spool::advanceTail(uint32_t size)
+{
+    if (tail_sector == head_sector)
+    {
+        tail_offset = size == 0 ? head_offset : tail_offset + size;
+        return;
+    }
+    tail_offset += size;
+    if (size == 0 || tail_offset + sizeof(RecordHeader) > sector_size)
+    {
+        tail_sector = (tail_sector + 1) % sectors;
+        tail_offset = sizeof(SectorHeader);
+    }
+}
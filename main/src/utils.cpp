@@ -5,7 +5,7 @@
 
 #include "esp_log.h"
 
-static const char *TAG = "UTILS";
+[[maybe_unused]] static const char *TAG = "UTILS";
 
 /**
  * @brief Format string